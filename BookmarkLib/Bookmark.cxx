@@ -43,27 +43,21 @@
 
 using namespace syncit;
 
-Bookmark::Bookmark() : BookmarkItem(NULL) {
+Bookmark::Bookmark(BookmarkArena *pa) : BookmarkItem(BOOKMARK, NULL, pa) {
 #ifndef NDEBUG
    strcpy(m_achStartTag, "Bookmark");
    strcpy(m_achEndTag, "Bookmark");
 #endif /* NDEBUG */
 
-   m_modified = 0L;
-   m_visited = 0L;
-
    assert(isValid());
 }
 
-Bookmark::Bookmark(const Bookmark &rhs) : BookmarkItem(rhs), m_href(rhs.m_href) {
+Bookmark::Bookmark(const Bookmark &rhs) : BookmarkItem(BOOKMARK, rhs, NULL), m_href(rhs.m_href) {
 #ifndef NDEBUG
    strcpy(m_achStartTag, "Bookmark");
    strcpy(m_achEndTag, "Bookmark");
 #endif /* NDEBUG */
 
-   m_modified = rhs.m_modified;
-   m_visited = rhs.m_visited;
-
    assert(isValid());
 }
 
@@ -79,17 +73,10 @@ Bookmark &Bookmark::operator=(const Bookmark &rhs) {
    BookmarkItem::operator=(rhs);
 
    m_href = rhs.m_href;
-   m_modified = rhs.m_modified;
-   m_visited = rhs.m_visited;
 
    return *this;
 }
 
-/* virtual */
-bool Bookmark::isBookmark() const {
-   return true;
-}
-
 #ifndef NDEBUG
 bool Bookmark::isValid() const {
    return strcmp(m_achStartTag, "Bookmark") == 0 &&
@@ -97,6 +84,13 @@ bool Bookmark::isValid() const {
 }
 #endif /* NDEBUG */
 
+void Bookmark::memoryStats(BookmarkMemoryStats &stats, unsigned long cRefs) const {
+   stats.add(BookmarkMemoryStats::NODES, sizeof(Bookmark), cRefs);
+
+   BookmarkItem::memoryStats(stats, cRefs);
+   m_href.memoryStats(stats, cRefs);
+}
+
 /**
  * Two bookmarks are equal if the names are equal,
  * the URLs are equal, and the modify times have the
@@ -114,14 +108,8 @@ bool Bookmark::equals(const BookmarkObject *pbo) const {
       else if (m_href != p->m_href) {
          return false;
       }
-      else if (m_pszName == NULL && p->m_pszName == NULL) {
-         return true;
-      }
-      else if (m_pszName == NULL || p->m_pszName == NULL) {
-         return false;
-      }
       else {
-         return tstricmp(m_pszName, p->m_pszName) == 0;
+         return sameName(p);
       }
    }
    else {
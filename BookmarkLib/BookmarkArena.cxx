@@ -0,0 +1,121 @@
+/*
+ * BookmarkLib/BookmarkArena.cxx
+ * Copyright (C) 2003  SyncIT.com, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * -----------------
+ * This program is GPL'd.  If you distribute this program or a derivative of
+ * this program publicly you must include the source code.  It is easy
+ * enough to drop me an email requesting a different license, if necessary.
+ *
+ * Description: BookmarkSync client software for Windows
+ * Created:     October 2026
+ * Web site:    http://www.syncit.com
+ */
+#pragma warning (disable : 4786)
+
+#include <cassert>
+
+#include "BookmarkModel.h"
+
+using namespace syncit;
+
+BookmarkArena::BookmarkArena() {
+   m_pChunks = NULL;
+   m_lRefCount = 1;
+}
+
+BookmarkArena::~BookmarkArena() {
+   Chunk *p = m_pChunks;
+
+   while (p != NULL) {
+      Chunk *pNext = p->pNext;
+
+      u_free(p);
+      p = pNext;
+   }
+}
+
+void BookmarkArena::Detach(BookmarkArena *p) {
+   if (p != NULL) {
+      assert(p->m_lRefCount != 0);
+
+      if (InterlockedDecrement(&p->m_lRefCount) == 0) {
+         delete p;
+      }
+   }
+}
+
+BookmarkArena::Chunk *BookmarkArena::newChunk(size_t cb) {
+   // keep the chunk header a multiple of 8 bytes, so allocations
+   // stay aligned
+   //
+   size_t cbHeader = (sizeof(Chunk) + 7) & ~7;
+   Chunk *p = (Chunk *) u_malloc(cbHeader + cb);
+
+   p->pNext = NULL;
+   p->cbFree = cb;
+   p->pFree = (char *) p + cbHeader;
+
+   return p;
+}
+
+void *BookmarkArena::allocate(size_t cb) {
+   cb = (cb + 7) & ~7;
+
+   if (m_pChunks == NULL || m_pChunks->cbFree < cb) {
+      if (cb > CHUNK_SIZE / 4) {
+         // big allocations get a chunk of their own, behind the
+         // one being filled
+         //
+         Chunk *p = newChunk(cb);
+
+         if (m_pChunks == NULL) {
+            m_pChunks = p;
+         }
+         else {
+            p->pNext = m_pChunks->pNext;
+            m_pChunks->pNext = p;
+         }
+
+         p->cbFree = 0;
+         return p->pFree;
+      }
+
+      Chunk *p = newChunk(CHUNK_SIZE);
+
+      p->pNext = m_pChunks;
+      m_pChunks = p;
+   }
+
+   void *pv = m_pChunks->pFree;
+
+   m_pChunks->pFree += cb;
+   m_pChunks->cbFree -= cb;
+
+   return pv;
+}
+
+tchar_t *BookmarkArena::stralloc(const tchar_t *psz) {
+   if (psz == NULL) {
+      return NULL;
+   }
+
+   size_t cb = (tstrlen(psz) + 1) * sizeof(tchar_t);
+   tchar_t *p = (tchar_t *) allocate(cb);
+
+   u_memcpy(p, psz, cb);
+   return p;
+}
@@ -90,7 +90,8 @@ BookmarkContext::~BookmarkContext() {
  * Create a new, blank bookmark and add it to the current folder
  */
 void BookmarkContext::startBookmark() {
-   Bookmark *p = NEW Bookmark();
+   BookmarkArena *pa = m_pModel->getArena();
+   Bookmark *p = new(pa) Bookmark(pa);
 
    p->setImages((BookmarkItem::ImageType) 0, m_apBookmarkImages[0]);
    p->setImages((BookmarkItem::ImageType) 1, m_apBookmarkImages[1]);
@@ -147,7 +148,8 @@ void BookmarkContext::setBookmarkHref(const char *s) {
  * Create a new, blank folder and add it to the current folder
  */
 void BookmarkContext::startFolder() {
-   BookmarkFolder *p = NEW BookmarkFolder();
+   BookmarkArena *pa = m_pModel->getArena();
+   BookmarkFolder *p = new(pa) BookmarkFolder(pa);
 
    p->setImages((BookmarkItem::ImageType) 0, m_apFolderImages[0]);
    p->setImages((BookmarkItem::ImageType) 1, m_apFolderImages[1]);
@@ -156,7 +158,8 @@ void BookmarkContext::startFolder() {
 }
 
 void BookmarkContext::startSubscription() {
-   BookmarkSubscription *p = NEW BookmarkSubscription();
+   BookmarkArena *pa = m_pModel->getArena();
+   BookmarkSubscription *p = new(pa) BookmarkSubscription(pa);
 
    p->setImages((BookmarkItem::ImageType) 0, m_apSubscriptionImages[0]);
    p->setImages((BookmarkItem::ImageType) 1, m_apSubscriptionImages[1]);
@@ -248,14 +251,18 @@ void BookmarkContext::popFolder() {
  * Creates a new separator and adds it to the current folder
  */
 void BookmarkContext::newSeparator() {
-   m_pCurrentFolder->add(NEW BookmarkSeparator());
+   BookmarkArena *pa = m_pModel->getArena();
+
+   m_pCurrentFolder->add(new(pa) BookmarkSeparator(pa));
 }
 
 /**
  * Creates a new bookmark alias and adds it to the current folder
  */
 void BookmarkContext::newAlias(const tchar_t *pszId) {
-   m_pCurrentFolder->add(NEW BookmarkAlias(pszId));
+   BookmarkArena *pa = m_pModel->getArena();
+
+   m_pCurrentFolder->add(new(pa) BookmarkAlias(pszId, pa));
 }
 
 /**
@@ -403,7 +410,9 @@ const tchar_t *BookmarkContext::startFolder(const tchar_t *pszPath,
       BookmarkFolder *pbfNew = pbf->findBookmarkFolder(achElement);
 
       if (pbfNew == NULL) {
-         pbfNew = NEW BookmarkFolder();
+         BookmarkArena *pa = m_pModel->getArena();
+
+         pbfNew = new(pa) BookmarkFolder(pa);
          pbfNew->setName(achElement);
 
          pbfNew->setImages((BookmarkItem::ImageType) 0, m_apFolderImages[0]);
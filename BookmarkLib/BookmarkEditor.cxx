@@ -40,36 +40,6 @@
 
 using namespace syncit;
 
-BookmarkFolder *FindFolder(BookmarkFolder *pbfRoot,
-                           BookmarkPath::const_iterator si, BookmarkPath::const_iterator se) {
-   if (si == se) {
-      return pbfRoot;
-   }
-   else {
-      const BookmarkFolder *pbfMatch = (*si);
-
-      BookmarkVector::const_iterator bi = pbfRoot->begin(), be = pbfRoot->end();
-
-      while (bi != be) {
-         if ((*bi)->isFolder()) {
-            BookmarkFolder *pbfSub = (BookmarkFolder *) (*bi);
-
-            if (EqualsIgnoreCase(pbfMatch->getName(), pbfSub->getName())) {
-               BookmarkFolder *pbfResult = FindFolder(pbfSub, si + 1, se);
-
-               if (pbfResult != NULL) {
-                  return pbfResult;
-               }
-            }
-         }
-
-         bi++;
-      }
-
-      return NULL;
-   }
-}
-
 BookmarkMerger::BookmarkMerger(BookmarkModel *pbm) {
 
 #ifndef NDEBUG
@@ -78,6 +48,7 @@ BookmarkMerger::BookmarkMerger(BookmarkModel *pbm) {
 #endif /* NDEBUG */
 
    m_pbm = pbm;
+   m_pbfEdit = NULL;
 
    assert(isValid());
 }
@@ -93,6 +64,7 @@ BookmarkMerger::~BookmarkMerger() {
 
 /* virtual */
 BookmarkEditor::~BookmarkEditor() {
+   BookmarkEditor::commit();
 }
 
 #ifndef NDEBUG
@@ -106,11 +78,21 @@ bool BookmarkMerger::isValid() const {
 /* virtual */
 void BookmarkMerger::pushFolder(const BookmarkFolder *pbf) {
    m_stack.push_back(pbf);
+   m_pbfEdit = NULL;
 }
 
 /* virtual */
 void BookmarkMerger::popFolder() {
    m_stack.pop_back();
+   m_pbfEdit = NULL;
+}
+
+BookmarkFolder *BookmarkMerger::getEditFolder() {
+   if (m_pbfEdit == NULL) {
+      m_pbfEdit = m_pbm->editFolder(m_stack.begin(), m_stack.end());
+   }
+
+   return m_pbfEdit;
 }
 
 /**
@@ -118,20 +100,36 @@ void BookmarkMerger::popFolder() {
  */
 /* virtual */
 void BookmarkMerger::addFolder(const BookmarkFolder *pfNew) {
-   BookmarkFolder *pbf = FindFolder(m_pbm, m_stack.begin(), m_stack.end());
+   BookmarkFolder *pbf = getEditFolder();
 
    assert(pbf != NULL);
 
-   pbf->add(NEW BookmarkFolder(*pfNew));
+   // pfNew is from another model: a subscription only goes in as a
+   // plain folder
+   //
+   BookmarkFolder *pfAdded;
+
+   if (pfNew->isSubscription()) {
+      pfAdded = m_pbm->adoptAsFolder(pfNew);
+   }
+   else {
+      pfAdded = (BookmarkFolder *) m_pbm->adopt(pfNew);
+   }
+
+   pbf->add(pfAdded);
+   m_pbm->defineAliasIds(pfAdded);
 }
 
 /* virtual */
 void BookmarkMerger::addBookmark(const Bookmark *pNew) {
-   BookmarkFolder *pbf = FindFolder(m_pbm, m_stack.begin(), m_stack.end());
+   BookmarkFolder *pbf = getEditFolder();
 
    assert(pbf != NULL);
 
-   pbf->add((BookmarkObject *) pNew->attach());
+   Bookmark *pbAdded = (Bookmark *) m_pbm->adopt(pNew);
+
+   pbf->add(pbAdded);
+   m_pbm->defineAliasIds(pbAdded);
 }
 
 /* virtual */
@@ -140,9 +138,14 @@ void BookmarkMerger::delBookmark(const Bookmark *pOld) {
 
 /* virtual */
 void BookmarkEditor::delBookmark(const Bookmark *pOld) {
-   Bookmark *pb = m_pbm->removeBookmark(m_stack.begin(), m_stack.end(), pOld);
+   BookmarkFolder *pbfParent;
+   Bookmark *pb = m_pbm->removeBookmark(m_stack.begin(), m_stack.end(), pOld, &pbfParent);
 
    if (pb != NULL) {
+      // its first hole: commit() compacts it once
+      //
+      if (pbfParent->getHoleCount() == 1) { m_edited.push_back(pbfParent); }
+
       if (pb->hasId()) { m_pbm->removeAliasId(pb->getId()); }
 
       BookmarkObject::Detach(pb);
@@ -151,11 +154,40 @@ void BookmarkEditor::delBookmark(const Bookmark *pOld) {
 
 /* virtual */
 void BookmarkEditor::del0(const BookmarkFolder *pOld) {
-   BookmarkFolder *pbf = m_pbm->removeFolder(m_stack.begin(), m_stack.end(), pOld);
+   BookmarkFolder *pbfParent;
+   BookmarkFolder *pbf = m_pbm->removeFolder(m_stack.begin(), m_stack.end(), pOld, &pbfParent);
 
    if (pbf != NULL) {
+      if (pbfParent->getHoleCount() == 1) { m_edited.push_back(pbfParent); }
+
       if (pbf->hasId()) { m_pbm->removeAliasId(pbf->getId()); }
 
-      BookmarkObject::Detach(pbf);
+      // m_edited may still point at it
+      //
+      if (pbf->hasHoles()) {
+         m_removed.push_back(pbf);
+      }
+      else {
+         BookmarkObject::Detach(pbf);
+      }
+   }
+}
+
+/* virtual */
+void BookmarkEditor::commit() {
+   vector<BookmarkFolder *>::iterator i = m_edited.begin(), end = m_edited.end();
+
+   while (i != end) {
+      (*i++)->compact();
    }
+
+   m_edited.clear();
+
+   i = m_removed.begin(), end = m_removed.end();
+
+   while (i != end) {
+      BookmarkObject::Detach(*i++);
+   }
+
+   m_removed.clear();
 }
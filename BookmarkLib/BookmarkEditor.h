@@ -71,9 +71,15 @@ public:
 protected:
    BookmarkFolder *getSubFolder();
 
+   // The folder of m_pbm at m_stack, unshared for editing.  It is
+   // looked up once per pushFolder() or popFolder().
+   //
+   BookmarkFolder *getEditFolder();
+
    BookmarkModel *m_pbm;
 
    BookmarkPath m_stack;
+   BookmarkFolder *m_pbfEdit;    // NULL until getEditFolder()
 
 private:
    // disable copy constructor and assignment
@@ -99,7 +105,16 @@ public:
    virtual void delBookmark(const Bookmark *pOld);
    virtual void del0(const BookmarkFolder *pOld);
 
+   /**
+    * Removals leave holes in their folders; commit() compacts each
+    * folder once, however many were removed from it.
+    */
+   virtual void commit();
+
 private:
+   vector<BookmarkFolder *> m_edited;    // folders with holes
+   vector<BookmarkFolder *> m_removed;   // removed, but with holes until commit()
+
    // disable copy constructor and assignment
    //
    BookmarkEditor(BookmarkEditor &rhs);
@@ -34,8 +34,10 @@
 #include <windows.h>
 
 #include <cstdlib>
+#include <algorithm>
 
 #include "BookmarkModel.h"
+#include "ProbeTable.h"
 
 #include "SyncLib\util.h"
 #include "SyncLib\text.h"
@@ -43,28 +45,43 @@
 
 using namespace syncit;
 
-BookmarkFolder::BookmarkFolder() : BookmarkItem("") {
+BookmarkFolder::BookmarkFolder(BookmarkArena *pa) : BookmarkItem(FOLDER, "", pa) {
 #ifndef NDEBUG
    strcpy(m_achStartTag, TEXT("BookmarkFolder"));
    strcpy(m_achEndTag, TEXT("BookmarkFolder"));
 #endif /* NDEBUG */
 
    m_fFolded = true;
+   m_cHoles = 0;
+   m_pindex = NULL;
+   m_lSummary = 0;
 }
 
-BookmarkFolder::BookmarkFolder(const BookmarkFolder &rhs) : BookmarkItem(rhs) {
+BookmarkFolder::BookmarkFolder(const BookmarkFolder &rhs, BookmarkArena *pa) : BookmarkItem(FOLDER, rhs, pa) {
 #ifndef NDEBUG
    strcpy(m_achStartTag, TEXT("BookmarkFolder"));
    strcpy(m_achEndTag, TEXT("BookmarkFolder"));
 #endif /* NDEBUG */
 
+   m_cHoles = 0;
+   m_pindex = NULL;
+   m_lSummary = 0;
    copy(rhs);
+
+   // the same elements, so the same summary
+   //
+   if (rhs.m_lSummary != 0) {
+      m_hashContent = rhs.m_hashContent;
+      m_cBookmarks = rhs.m_cBookmarks;
+      m_lSummary = 1;
+   }
 }
 
 BookmarkFolder::~BookmarkFolder() {
    assert(isValid());
 
    detachall();
+   destroyIndex();
 
 #ifndef NDEBUG
    m_achStartTag[0] = m_achEndTag[0] = '\0';
@@ -85,28 +102,60 @@ void BookmarkFolder::copy(const BookmarkFolder &rhs) {
    BookmarkVector::const_iterator i = rhs.begin(), end = rhs.end();
 
    while (i != end) {
-      BookmarkObject *pold = *i++, *pnew;
+      BookmarkObject *p = *i++;
 
-      if (pold->isBookmark()) {
-         pnew = pold->attach();
-      }
-      else if (pold->isFolder()) {
-         pnew = NEW BookmarkFolder(*(const BookmarkFolder *) pold);
+      // shared, see BookmarkModel::editFolder()
+      //
+      if (p != NULL) {
+         add(p->attach());
       }
-      else if (pold->isAlias()) {
-         pnew = pold->attach();
-      }
-      else if (pold->isSeparator()) {
-         pnew = pold->attach();
-      }
-      else {
-         assert(pold->isFolder() || pold->isBookmark() || pold->isAlias() || pold->isSeparator());
+   }
+
+   m_fFolded = rhs.m_fFolded;
+}
+
+BookmarkWalker::Event BookmarkWalker::next() {
+   const BookmarkFolder *pbf = m_pbfRoot;
+
+   if (pbf == NULL) {
+      // the holes removals leave until BookmarkFolder::compact() are
+      // passed over
+      //
+      do {
+         if (m_stack.empty()) {
+            m_p = NULL;
+            return END;
+         }
+
+         Frame &f = m_stack.back();
+
+         if (f.i == f.pbf->end()) {
+            m_p = f.pbf;
+            m_stack.pop_back();
+            m_depth = m_stack.size();
+            return LEAVE;
+         }
+
+         m_p = *f.i++;
+      } while (m_p == NULL);
+
+      m_depth = m_stack.size();
+
+      if (!m_p->isFolder()) {
+         return ITEM;
       }
 
-      add(pnew);
+      pbf = (const BookmarkFolder *) m_p;
    }
 
-   m_fFolded = rhs.m_fFolded;
+   Frame f = { pbf, pbf->begin() };
+
+   m_stack.push_back(f);
+   m_pbfRoot = NULL;
+   m_p = pbf;
+   m_depth = m_stack.size() - 1;
+
+   return ENTER;
 }
 
 void BookmarkFolder::detachall() {
@@ -116,11 +165,6 @@ void BookmarkFolder::detachall() {
    }
 }
 
-/* virtual */
-bool BookmarkFolder::isFolder() const {
-   return true;
-}
-
 /* virtual */
 bool BookmarkFolder::isSubscription() const {
    return false;
@@ -136,7 +180,7 @@ bool BookmarkFolder::equals(const BookmarkObject *pbo) const {
       if (this == p) {
          return true;
       }
-      else if (tstricmp(m_pszName, p->m_pszName) != 0 ||
+      else if (!sameName(p) ||
                m_elements.size() != p->m_elements.size()) {
          return false;
       }
@@ -169,143 +213,426 @@ bool BookmarkFolder::isValid() const {
 */
    return strcmp(m_achStartTag, "BookmarkFolder") == 0 &&
           strcmp(m_achEndTag, "BookmarkFolder") == 0 &&
-          m_pszName != NULL;
+          hasName();
 }
 
 #endif /* NDEBUG */
 
-Bookmark *BookmarkFolder::findBookmark(LPCTSTR pszName) const {
-   assert(isValid());
-   assert(pszName != NULL);
-
-   BookmarkVector::const_iterator i = m_elements.begin(), end = m_elements.end();
-   // just a bookmark name, find bookmark with same title, href
+/**
+ * An open-addressing hash table (linear probing) of a folder's
+ * bookmarks and subfolders, keyed on the folded hash of their names.
+ * Children with the same name have the same home slot, and stay in
+ * element order along the probe sequence: add() appends, erase()
+ * shifts entries back in order, and growing rebuilds from the elements.
+ * Each entry also holds the child's position in the elements, which
+ * stays put until BookmarkFolder::compact() drops the index.
+ */
+class BookmarkFolder::Index {
+public:
+   Index(const BookmarkVector &v) : m_v(v) {
+      m_pslots = NULL;
+      m_cSlots = 0;
+      rebuild(64);
+   }
 
-   while (i != end) {
-      if ((*i)->isBookmark()) {
-         Bookmark *pb = (Bookmark *) (*i);
+   ~Index() {
+      u_free0(m_pslots);
+   }
 
-         if (EqualsIgnoreCase(pb->getName(), pszName)) {
-            return pb;
+   // p has just been appended to the elements
+   //
+   void add(BookmarkObject *p) {
+      if (p->isBookmark() || p->isFolder()) {
+         // keep the table at most half full
+         //
+         if ((m_cUsed + 1) * 2 > m_cSlots) {
+            rebuild(m_cSlots * 2);
+         }
+         else {
+            insert((BookmarkItem *) p, m_v.size() - 1);
          }
       }
+   }
+
+   void erase(const BookmarkObject *p);
+   void replace(const BookmarkObject *pOld, BookmarkObject *pNew);
+
+   BookmarkItem *next(unsigned __int64 hash, size_t &i, size_t *pk) const;
 
-      i++;
+   size_t getMemorySize() const {
+      return sizeof(*this) + m_cSlots * sizeof(Slot);
    }
 
-   return NULL;
+private:
+   struct Slot {
+      unsigned __int64 hash;
+      BookmarkItem *p;           // NULL for an empty slot
+      size_t k;                  // position of p in the elements
+   };
+
+   struct SlotTraits {
+      bool empty(const Slot &slot) const {
+         return slot.p == NULL;
+      }
+
+      unsigned __int64 hash(const Slot &slot) const {
+         return slot.hash;
+      }
+
+      void clear(Slot &slot) const {
+         slot.p = NULL;
+      }
+   };
+
+   static unsigned __int64 Key(const BookmarkObject *p) {
+      return ((const BookmarkItem *) p)->getNameAtom().getFoldedHash();
+   }
+
+   size_t find(const BookmarkObject *p) const;
+   void insert(BookmarkItem *p, size_t k);
+   void rebuild(size_t cSlots);
+
+   const BookmarkVector &m_v;
+   Slot  *m_pslots;
+   size_t m_cSlots;              // a power of two
+   size_t m_cUsed;
+};
+
+void BookmarkFolder::Index::rebuild(size_t cSlots) {
+   while (m_v.size() * 2 > cSlots) {
+      cSlots *= 2;
+   }
+
+   u_free0(m_pslots);
+
+   m_pslots = (Slot *) u_calloc(cSlots, sizeof(Slot));
+   m_cSlots = cSlots;
+   m_cUsed = 0;
+
+   for (size_t k = 0; k < m_v.size(); k++) {
+      BookmarkObject *p = m_v[k];
+
+      if (p != NULL && (p->isBookmark() || p->isFolder())) {
+         insert((BookmarkItem *) p, k);
+      }
+   }
+}
+
+void BookmarkFolder::Index::insert(BookmarkItem *p, size_t k) {
+   unsigned __int64 hash = Key(p);
+   size_t i = ProbeEmpty(m_pslots, m_cSlots, hash, SlotTraits());
+
+   m_pslots[i].hash = hash;
+   m_pslots[i].p = p;
+   m_pslots[i].k = k;
+   m_cUsed++;
 }
 
-Bookmark *BookmarkFolder::removeBookmark(BookmarkPath::const_iterator i, BookmarkPath::const_iterator e, const Bookmark *pb) {
-   BookmarkVector::iterator bi = m_elements.begin(), be = m_elements.end();
+size_t BookmarkFolder::Index::find(const BookmarkObject *p) const {
+   size_t mask = m_cSlots - 1;
+   size_t i = (size_t) Key(p) & mask;
 
-   if (i == e) {
-      while (bi != be) {
-         if ((*bi)->isBookmark()) {
-            Bookmark *pbMatch = (Bookmark *) (*bi);
+   while (m_pslots[i].p != p) {
+      assert(m_pslots[i].p != NULL);
+      i = (i + 1) & mask;
+   }
 
-            if (EqualsIgnoreCase(pb->getName(), pbMatch->getName()) &&
-                pb->getHref() == pbMatch->getHref()) {
-               m_elements.erase(bi);
-               return pbMatch;
-            }
+   return i;
+}
+
+void BookmarkFolder::Index::erase(const BookmarkObject *p) {
+   if (!p->isBookmark() && !p->isFolder()) {
+      return;
+   }
+
+   ProbeErase(m_pslots, m_cSlots, find(p), SlotTraits());
+   m_cUsed--;
+}
+
+void BookmarkFolder::Index::replace(const BookmarkObject *pOld, BookmarkObject *pNew) {
+   if (pOld->isBookmark() || pOld->isFolder()) {
+      Slot &slot = m_pslots[find(pOld)];
+
+      assert(slot.hash == Key(pNew));
+      slot.p = (BookmarkItem *) pNew;
+   }
+}
+
+BookmarkItem *BookmarkFolder::Index::next(unsigned __int64 hash, size_t &i, size_t *pk) const {
+   size_t mask = m_cSlots - 1;
+
+   // i is 0 to start, else one more than the next slot to look at
+   //
+   size_t j = i == 0 ? (size_t) hash & mask : i - 1;
+   BookmarkItem *p;
+
+   while ((p = m_pslots[j].p) != NULL) {
+      j = (j + 1) & mask;
+
+      const Slot &slot = m_pslots[(j - 1) & mask];
+
+      if (slot.hash == hash) {
+         if (pk != NULL) {
+            *pk = slot.k;
          }
 
-         bi++;
+         i = j + 1;
+         return p;
       }
    }
-   else {
-      const BookmarkFolder *pbfMatch = (*i);
 
-      while (bi != be) {
-         if ((*bi)->isFolder()) {
-            BookmarkFolder *pbfSub = (BookmarkFolder *) (*bi);
+   return NULL;
+}
 
-            if (EqualsIgnoreCase(pbfMatch->getName(), pbfSub->getName())) {
-               Bookmark *pbResult = pbfSub->removeBookmark(i + 1, e, pb);
+const BookmarkFolder::Index *BookmarkFolder::index() const {
+   if (m_pindex == NULL && m_elements.size() >= INDEX_MIN) {
+      // The folder may be shared with other threads, which only ever
+      // read it: the first index to be published wins.
+      //
+      Index *p = NEW Index(m_elements);
 
-               if (pbResult != NULL) {
-                  return pbResult;
-               }
-            }
+      if (InterlockedCompareExchangePointer((PVOID volatile *) &m_pindex, p, NULL) != NULL) {
+         delete p;
+      }
+   }
+
+   return m_pindex;
+}
+
+void BookmarkFolder::indexAdd(BookmarkObject *p) {
+   m_pindex->add(p);
+}
+
+void BookmarkFolder::destroyIndex() {
+   delete m_pindex;
+   m_pindex = NULL;
+}
+
+void BookmarkFolder::memoryStats(BookmarkMemoryStats &stats, unsigned long cRefs) const {
+   stats.add(BookmarkMemoryStats::NODES, isSubscription() ? sizeof(BookmarkSubscription) : sizeof(BookmarkFolder), cRefs);
+
+   BookmarkItem::memoryStats(stats, cRefs);
+
+   stats.add(BookmarkMemoryStats::VECTORS, m_elements.capacity() * sizeof(BookmarkObject *), cRefs);
+
+   if (m_pindex != NULL) {
+      stats.add(BookmarkMemoryStats::VECTORS, m_pindex->getMemorySize(), cRefs);
+   }
+}
+
+BookmarkItem *BookmarkFolder::nextHashed(unsigned __int64 hash, size_t &i, size_t *pk) const {
+   const Index *pindex = index();
+
+   if (pindex != NULL) {
+      return pindex->next(hash, i, pk);
+   }
+
+   size_t n = m_elements.size();
+
+   while (i < n) {
+      BookmarkObject *p = m_elements[i++];
+
+      if (p != NULL && (p->isBookmark() || p->isFolder()) &&
+          ((BookmarkItem *) p)->getNameAtom().getFoldedHash() == hash) {
+         if (pk != NULL) {
+            *pk = i - 1;
          }
 
-         bi++;
+         return (BookmarkItem *) p;
       }
    }
 
    return NULL;
 }
 
-BookmarkFolder *BookmarkFolder::findBookmarkFolder(LPCTSTR pszName) const {
-   assert(isValid());
-   assert(pszName != NULL);
+BookmarkItem *BookmarkFolder::nextNamed(const BookmarkName &name, size_t &i, size_t *pk) const {
+   BookmarkItem *p;
 
-   BookmarkVector::const_iterator i = m_elements.begin(), end = m_elements.end();
-   // just a bookmark name, find bookmark with same title, href
+   while ((p = nextHashed(name.getFoldedHash(), i, pk)) != NULL) {
+      if (p->getNameAtom().equalsIgnoreCase(name)) {
+         break;
+      }
+   }
 
-   while (i != end) {
-      if ((*i)->isFolder()) {
-         BookmarkFolder *pb = (BookmarkFolder *) (*i);
+   return p;
+}
 
-         if (EqualsIgnoreCase(pb->getName(), pszName)) {
-            return pb;
-         }
+BookmarkItem *BookmarkFolder::nextNamed(const tchar_t *psz, size_t &i, size_t *pk) const {
+   unsigned __int64 hash = BookmarkName::FoldedHash(psz);
+   BookmarkItem *p;
+
+   while ((p = nextHashed(hash, i, pk)) != NULL) {
+      if (p->hasName() && EqualsIgnoreCase(p->getName(), psz)) {
+         break;
       }
+   }
+
+   return p;
+}
 
-      i++;
+void BookmarkFolder::erase(size_t k) {
+   BookmarkObject *p = m_elements[k];
+
+   if (m_pindex != NULL) {
+      m_pindex->erase(p);
    }
 
-   return NULL;
+   m_elements[k] = NULL;
+   m_cHoles++;
+   m_lSummary = 0;
+}
+
+void BookmarkFolder::compact() {
+   if (m_cHoles != 0) {
+      m_elements.erase(std::remove(m_elements.begin(), m_elements.end(), (BookmarkObject *) NULL),
+                       m_elements.end());
+      m_cHoles = 0;
+
+      // the positions in the index have moved: the next search
+      // builds a new one
+      //
+      destroyIndex();
+   }
+}
+
+void BookmarkFolder::replace(BookmarkObject *pOld, BookmarkObject *pNew) {
+   *std::find(m_elements.begin(), m_elements.end(), pOld) = pNew;
+   m_lSummary = 0;
+
+   if (m_pindex != NULL) {
+      m_pindex->replace(pOld, pNew);
+   }
 }
 
-BookmarkFolder *BookmarkFolder::removeFolder(BookmarkPath::const_iterator i, BookmarkPath::const_iterator e, const BookmarkFolder *pf) {
-   BookmarkVector::iterator bi = m_elements.begin(), be = m_elements.end();
+// content hash and bookmark count of a folder being summarized
+//
+struct Sum {
+   unsigned __int64 hash;
+   unsigned long cBookmarks;
+};
 
-   if (i == e) {
-      while (bi != be) {
-         if ((*bi)->isFolder()) {
-            BookmarkFolder *pfMatch = (BookmarkFolder *) (*bi);
+void BookmarkFolder::summarize() const {
+   BookmarkWalker walker(this);
+   BookmarkWalker::Event e;
+   vector<Sum> sums;
 
-            if (EqualsIgnoreCase(pf->getName(), pfMatch->getName())) {
-               BookmarkVector::const_iterator ei = pfMatch->begin(), ee = pfMatch->end();
-               bool empty = true;
+   while ((e = walker.next()) != BookmarkWalker::END) {
+      const BookmarkObject *p = walker.get();
 
-               while (ei != ee && empty == true) {
-                  if ((*ei)->isBookmark() || (*ei)->isFolder()) {
-                     empty = false;
-                  }
+      switch (e) {
+         case BookmarkWalker::ENTER: {
+            Sum sum = { 0, 0 };
 
-                  ei++;
+            sums.push_back(sum);
+
+            if (((const BookmarkFolder *) p)->m_lSummary != 0) {
+               walker.skip();
+            }
+            break;
+         }
+
+         case BookmarkWalker::ITEM:
+            if (p->isBookmark()) {
+               const Bookmark *pb = (const Bookmark *) p;
+               Sum &sum = sums.back();
+
+               sum.cBookmarks++;
+
+               if (pb->getName()[0] != '.') {
+                  sum.hash += Href::Mix(pb->getNameAtom().getFoldedHash() ^ Href::Mix(pb->getHref().getHash()));
                }
+            }
+            break;
+
+         case BookmarkWalker::LEAVE: {
+            const BookmarkFolder *pbf = (const BookmarkFolder *) p;
+
+            if (pbf->m_lSummary == 0) {
+               pbf->m_hashContent = sums.back().hash;
+               pbf->m_cBookmarks = sums.back().cBookmarks;
+               InterlockedExchange(&pbf->m_lSummary, 1);
+            }
 
-               if (empty) {
-                  m_elements.erase(bi);
-                  return pfMatch;
+            sums.pop_back();
+
+            if (!sums.empty()) {
+               Sum &sum = sums.back();
+
+               sum.cBookmarks += pbf->m_cBookmarks;
+
+               // tagged, so a folder can't pass for a bookmark
+               //
+               if (pbf->getName()[0] != '.') {
+                  sum.hash += Href::Mix(pbf->getNameAtom().getFoldedHash() ^
+                                        Href::Mix(pbf->m_hashContent ^ 0x9E3779B97F4A7C15ui64));
                }
             }
+            break;
          }
+      }
+   }
+}
+
+Bookmark *BookmarkFolder::findBookmark(LPCTSTR pszName) const {
+   assert(isValid());
+   assert(pszName != NULL);
 
-         bi++;
+   size_t i = 0;
+   BookmarkItem *p;
+
+   while ((p = nextNamed(pszName, i)) != NULL) {
+      if (p->isBookmark()) {
+         return (Bookmark *) p;
       }
    }
-   else {
-      const BookmarkFolder *pbfMatch = (*i);
 
-      while (bi != be) {
-         if ((*bi)->isFolder()) {
-            BookmarkFolder *pbfSub = (BookmarkFolder *) (*bi);
+   return NULL;
+}
+
+BookmarkFolder *BookmarkFolder::findBookmarkFolder(LPCTSTR pszName) const {
+   assert(isValid());
+   assert(pszName != NULL);
 
-            if (EqualsIgnoreCase(pbfMatch->getName(), pbfSub->getName())) {
-               BookmarkFolder *pfResult = pbfSub->removeFolder(i + 1, e, pf);
+   size_t i = 0;
+   BookmarkItem *p;
 
-               if (pfResult != NULL) {
-                  return pfResult;
-               }
+   while ((p = nextNamed(pszName, i)) != NULL) {
+      if (p->isFolder()) {
+         return (BookmarkFolder *) p;
+      }
+   }
+
+   return NULL;
+}
+
+BookmarkItem *BookmarkFolder::findRemovable(const BookmarkItem *pItem, size_t *pk) const {
+   size_t j = 0;
+   BookmarkItem *p;
+
+   while ((p = nextNamed(pItem->getNameAtom(), j, pk)) != NULL) {
+      if (pItem->isBookmark()) {
+         if (p->isBookmark() && ((const Bookmark *) pItem)->getHref() == ((Bookmark *) p)->getHref()) {
+            return p;
+         }
+      }
+      else if (p->isFolder()) {
+         BookmarkFolder *pfMatch = (BookmarkFolder *) p;
+         BookmarkVector::const_iterator ei = pfMatch->begin(), ee = pfMatch->end();
+         bool empty = true;
+
+         // its own removals may have left holes in it
+         //
+         while (ei != ee && empty == true) {
+            if (*ei != NULL && ((*ei)->isBookmark() || (*ei)->isFolder())) {
+               empty = false;
             }
+
+            ei++;
          }
 
-         bi++;
+         if (empty) {
+            return pfMatch;
+         }
       }
    }
 
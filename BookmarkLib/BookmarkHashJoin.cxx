@@ -0,0 +1,350 @@
+/*
+ * BookmarkLib/BookmarkHashJoin.cxx
+ * Copyright (C) 2003  SyncIT.com, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * -----------------
+ * This program is GPL'd.  If you distribute this program or a derivative of
+ * this program publicly you must include the source code.  It is easy
+ * enough to drop me an email requesting a different license, if necessary.
+ *
+ * Description: BookmarkSync client software for Windows
+ * Created:     October 2026
+ * Web site:    http://www.syncit.com
+ */
+#pragma warning (disable : 4786)
+
+#include "BookmarkModel.h"
+
+using namespace syncit;
+
+// An entry of the scratch table.  Entries left from an earlier join
+// carry an old generation and read as empty, so the table is never
+// cleared, only grown.
+//
+struct JoinSlot {
+   unsigned __int64 hash;
+   size_t i;               // a side-2 bookmark, or a folder group
+   unsigned long gen;
+};
+
+// The same-named folders of one level, as lists threaded through
+// HashJoin::m_next.
+//
+struct JoinGroup {
+   size_t head1, tail1, c1;
+   size_t head2, tail2, c2;
+};
+
+class HashJoin {
+public:
+   HashJoin(BookmarkDifferences *pdiff, unsigned flags) :
+      m_pdiff(pdiff),
+      m_fEquivalent((flags & DIFF_EQUIVALENT_HREFS) != 0),
+      m_gen(0) {
+   }
+
+   int diff(const BookmarkFolder *pbf1, const BookmarkFolder *pbf2);
+
+private:
+   enum { NONE = (size_t) -1 };
+
+   int diffLevel(size_t i1, size_t c1, size_t i2, size_t c2);
+   int joinBookmarks();
+
+   // start a new generation of the table, with room for c entries
+   void prepare(size_t c);
+
+   unsigned __int64 hashOf(const Bookmark *p) const {
+      return Href::Mix(p->getNameAtom().getFoldedHash() ^
+                       Href::Mix(m_fEquivalent ? p->getHref().getEquivalenceHash()
+                                               : p->getHref().getHash()));
+   }
+
+   bool same(const Bookmark *p1, const Bookmark *p2) const {
+      return p1->getNameAtom().equalsIgnoreCase(p2->getNameAtom()) &&
+             (m_fEquivalent ? Href::CompareEquivalent(p1->getHref(), p2->getHref())
+                            : Href::Compare(p1->getHref(), p2->getHref())) == 0;
+   }
+
+   BookmarkDifferences *m_pdiff;
+   bool m_fEquivalent;
+
+   vector<JoinSlot> m_slots;
+   unsigned long m_gen;
+
+   vector<const Bookmark *> m_b1, m_b2;   // the current level only
+   vector<char> m_matched;                // parallel to m_b2
+
+   vector<const BookmarkFolder *> m_f;    // every open level, as a stack
+   vector<size_t> m_next;                 // parallel to m_f
+   vector<JoinGroup> m_groups;            // every open level, as a stack
+};
+
+void HashJoin::prepare(size_t c) {
+   size_t cSlots = 16;
+
+   while (cSlots < 2 * c) {
+      cSlots *= 2;
+   }
+
+   if (++m_gen == 0 || m_slots.size() < cSlots) {
+      JoinSlot empty = { 0, 0, 0 };
+
+      m_slots.assign(cSlots > m_slots.size() ? cSlots : m_slots.size(), empty);
+      m_gen = 1;
+   }
+}
+
+/**
+ * Match m_b1 against m_b2 as a multiset: each side-1 bookmark takes at
+ * most one equal side-2 bookmark, the rest are added or deleted.
+ */
+int HashJoin::joinBookmarks() {
+   int r = 0;
+   size_t c1 = m_b1.size(), c2 = m_b2.size();
+   size_t k;
+
+   if (c2 == 0) {
+      for (k = 0; k < c1; k++) {
+         m_pdiff->addBookmark(m_b1[k]);
+         r++;
+      }
+
+      return r;
+   }
+
+   prepare(c2);
+   m_matched.assign(c2, 0);
+
+   // the table's size is a power of 2, but may be bigger than
+   // prepare() asked for
+   size_t mask = m_slots.size() - 1;
+
+   for (k = 0; k < c2; k++) {
+      unsigned __int64 h = hashOf(m_b2[k]);
+      size_t j = (size_t) h & mask;
+
+      while (m_slots[j].gen == m_gen) {
+         j = (j + 1) & mask;
+      }
+
+      m_slots[j].hash = h;
+      m_slots[j].i = k;
+      m_slots[j].gen = m_gen;
+   }
+
+   for (k = 0; k < c1; k++) {
+      const Bookmark *p = m_b1[k];
+      unsigned __int64 h = hashOf(p);
+      size_t j = (size_t) h & mask;
+      bool fFound = false;
+
+      while (m_slots[j].gen == m_gen) {
+         const JoinSlot &slot = m_slots[j];
+
+         if (slot.hash == h && !m_matched[slot.i] && same(p, m_b2[slot.i])) {
+            m_matched[slot.i] = 1;
+            fFound = true;
+            break;
+         }
+
+         j = (j + 1) & mask;
+      }
+
+      if (!fFound) {
+         m_pdiff->addBookmark(p);
+         r++;
+      }
+   }
+
+   for (k = 0; k < c2; k++) {
+      if (!m_matched[k]) {
+         m_pdiff->delBookmark(m_b2[k]);
+         r++;
+      }
+   }
+
+   return r;
+}
+
+/**
+ * Diff the merged contents of the c1 folders at m_f[i1] against those of
+ * the c2 folders at m_f[i2], the way diffFolders() does for a group of
+ * same-named folders.
+ */
+int HashJoin::diffLevel(size_t i1, size_t c1, size_t i2, size_t c2) {
+   size_t k;
+
+   // gather the contents of every folder on each side
+   //
+   m_b1.clear();
+   m_b2.clear();
+
+   size_t base1 = m_f.size();
+
+   for (k = 0; k < c1; k++) {
+      ExtractFromFolder(m_f[i1 + k], m_b1, m_f);
+   }
+
+   size_t base2 = m_f.size();
+
+   for (k = 0; k < c2; k++) {
+      ExtractFromFolder(m_f[i2 + k], m_b2, m_f);
+   }
+
+   size_t end = m_f.size();
+
+   m_next.resize(end);
+
+   int r = joinBookmarks();
+
+   // group the subfolders by name; the table is free again once the
+   // groups are made, so the levels below can have it
+   //
+   size_t baseGroups = m_groups.size();
+
+   prepare(end - base1);
+
+   size_t mask = m_slots.size() - 1;
+
+   for (k = base1; k < end; k++) {
+      const BookmarkFolder *pf = m_f[k];
+      bool fSide1 = k < base2;
+      unsigned __int64 h = pf->getNameAtom().getFoldedHash();
+      size_t j = (size_t) h & mask;
+      size_t g = NONE;
+
+      while (m_slots[j].gen == m_gen) {
+         const JoinSlot &slot = m_slots[j];
+
+         if (slot.hash == h) {
+            const JoinGroup &group = m_groups[slot.i];
+
+            if (pf->sameName(m_f[group.head1 != NONE ? group.head1 : group.head2])) {
+               g = slot.i;
+               break;
+            }
+         }
+
+         j = (j + 1) & mask;
+      }
+
+      if (g == NONE) {
+         JoinGroup group = { NONE, NONE, 0, NONE, NONE, 0 };
+
+         g = m_groups.size();
+         m_groups.push_back(group);
+
+         m_slots[j].hash = h;
+         m_slots[j].i = g;
+         m_slots[j].gen = m_gen;
+      }
+
+      JoinGroup &group = m_groups[g];
+      size_t &head = fSide1 ? group.head1 : group.head2;
+      size_t &tail = fSide1 ? group.tail1 : group.tail2;
+
+      if (head == NONE) {
+         head = k;
+      }
+      else {
+         m_next[tail] = k;
+      }
+
+      tail = k;
+      m_next[k] = NONE;
+      (fSide1 ? group.c1 : group.c2)++;
+   }
+
+   size_t endGroups = m_groups.size();
+
+   for (size_t g = baseGroups; g < endGroups; g++) {
+      // copied, since the levels below grow m_groups
+      JoinGroup group = m_groups[g];
+
+      if (group.c2 == 0) {
+         for (k = group.head1; k != NONE; k = m_next[k]) {
+            m_pdiff->addFolder(m_f[k]);
+            r++;
+         }
+      }
+      else if (group.c1 == 0) {
+         for (k = group.head2; k != NONE; k = m_next[k]) {
+            m_pdiff->delFolder(m_f[k]);
+            r++;
+         }
+      }
+      else if (group.c1 == 1 && group.c2 == 1 &&
+               m_f[group.head1]->getContentHash() == m_f[group.head2]->getContentHash()) {
+         // a lone folder on each side, with the same contents: there
+         // is nothing to report below it
+      }
+      else {
+         // lay the group out side by side at the top of the stack
+         //
+         size_t top = m_f.size();
+
+         for (k = group.head1; k != NONE; k = m_next[k]) {
+            const BookmarkFolder *pf = m_f[k];
+
+            m_f.push_back(pf);
+         }
+
+         for (k = group.head2; k != NONE; k = m_next[k]) {
+            const BookmarkFolder *pf = m_f[k];
+
+            m_f.push_back(pf);
+         }
+
+         m_next.resize(m_f.size());
+
+         m_pdiff->pushFolderPair(m_f[group.head1], m_f[group.head2]);
+         r += diffLevel(top, group.c1, top + group.c1, group.c2);
+         m_pdiff->popFolder();
+
+         m_f.resize(top);
+         m_next.resize(top);
+      }
+   }
+
+   m_f.resize(base1);
+   m_next.resize(base1);
+   m_groups.resize(baseGroups);
+
+   return r;
+}
+
+int HashJoin::diff(const BookmarkFolder *pbf1, const BookmarkFolder *pbf2) {
+   m_f.push_back(pbf1);
+   m_f.push_back(pbf2);
+   m_next.resize(2);
+
+   int r = diffLevel(0, 1, 1, 1);
+
+   m_f.clear();
+   m_next.clear();
+
+   return r;
+}
+
+int syncit::HashJoinDiff(const BookmarkFolder *pbf1,
+                         const BookmarkFolder *pbf2,
+                         BookmarkDifferences *pdiff,
+                         unsigned flags) {
+   HashJoin join(pdiff, flags);
+
+   return join.diff(pbf1, pbf2);
+}
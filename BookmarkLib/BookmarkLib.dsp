@@ -93,6 +93,10 @@ SOURCE=.\Bookmark.cxx
 # End Source File
 # Begin Source File
 
+SOURCE=.\BookmarkArena.cxx
+# End Source File
+# Begin Source File
+
 SOURCE=.\BookmarkContext.cxx
 # End Source File
 # Begin Source File
@@ -105,10 +109,26 @@ SOURCE=.\BookmarkFolder.cxx
 # End Source File
 # Begin Source File
 
+SOURCE=.\BookmarkHashJoin.cxx
+# End Source File
+# Begin Source File
+
+SOURCE=.\BookmarkMerge3.cxx
+# End Source File
+# Begin Source File
+
 SOURCE=.\BookmarkModel.cxx
 # End Source File
 # Begin Source File
 
+SOURCE=.\BookmarkName.cxx
+# End Source File
+# Begin Source File
+
+SOURCE=.\BookmarkSort.cxx
+# End Source File
+# Begin Source File
+
 SOURCE=.\Href.cxx
 # End Source File
 # Begin Source File
@@ -161,6 +181,10 @@ SOURCE=.\BookmarkModel.h
 # End Source File
 # Begin Source File
 
+SOURCE=.\ProbeTable.h
+# End Source File
+# Begin Source File
+
 SOURCE=.\BrowserBookmarks.h
 # End Source File
 # Begin Source File
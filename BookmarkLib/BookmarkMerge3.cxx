@@ -0,0 +1,330 @@
+/*
+ * BookmarkLib/BookmarkMerge3.cxx
+ * Copyright (C) 2003  SyncIT.com, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * -----------------
+ * This program is GPL'd.  If you distribute this program or a derivative of
+ * this program publicly you must include the source code.  It is easy
+ * enough to drop me an email requesting a different license, if necessary.
+ *
+ * Description: BookmarkSync client software for Windows
+ * Created:     October 2026
+ * Web site:    http://www.syncit.com
+ */
+#pragma warning (disable : 4786)
+
+#include <algorithm>
+
+#include "BookmarkModel.h"
+
+using namespace syncit;
+
+// the same-named folders of one side at one level, merged as diff()
+// merges them
+//
+struct Merge3Group {
+   const BookmarkFolder *const *ppbf;
+   size_t c;
+
+   const BookmarkFolder *first() const {
+      return c > 0 ? ppbf[0] : NULL;
+   }
+
+   void getContentHashes(vector<unsigned __int64> &v) const {
+      v.resize(c);
+
+      for (size_t i = 0; i < c; i++) {
+         v[i] = ppbf[i]->getContentHash();
+      }
+
+      sort(v.begin(), v.end());
+   }
+};
+
+// sides of a Merge3
+//
+enum { BASE, LOCAL, REMOTE, SIDES };
+
+class Merge3 {
+public:
+   Merge3(BookmarkDifferences *pdiff, BookmarkConflicts *pconflicts, unsigned flags) :
+      m_pdiff(pdiff),
+      m_pconflicts(pconflicts),
+      m_fEquivalent((flags & DIFF_EQUIVALENT_HREFS) != 0) {
+   }
+
+   int merge(const Merge3Group *groups);
+
+private:
+   int mergeBookmarks(const vector<const Bookmark *> *vb);
+   int mergeFolders(const vector<const BookmarkFolder *> *vf);
+
+   bool unchanged(const Merge3Group &g1, const Merge3Group &g2) const;
+
+   void conflict(const BookmarkItem *pBase, const BookmarkItem *pLocal, const BookmarkItem *pRemote) {
+      if (m_pconflicts != NULL) {
+         m_pconflicts->conflict(pBase, pLocal, pRemote);
+      }
+   }
+
+   BookmarkDifferences *m_pdiff;
+   BookmarkConflicts *m_pconflicts;
+   bool m_fEquivalent;
+};
+
+/**
+ * Two groups are unchanged if they hold folders of the same contents,
+ * compared folder by folder: summing the hashes would let same-named
+ * folders swap contents unnoticed.
+ */
+bool Merge3::unchanged(const Merge3Group &g1, const Merge3Group &g2) const {
+   if (g1.c != g2.c) {
+      return false;
+   }
+
+   if (g1.c == 1) {
+      return g1.ppbf[0]->getContentHash() == g2.ppbf[0]->getContentHash();
+   }
+
+   vector<unsigned __int64> v1, v2;
+
+   g1.getContentHashes(v1);
+   g2.getContentHashes(v2);
+
+   return v1 == v2;
+}
+
+/**
+ * Merge the contents of a group of same-named folders on each side;
+ * the base group may be empty.
+ */
+int Merge3::merge(const Merge3Group *groups) {
+   vector<const Bookmark *> vb[SIDES];
+   vector<const BookmarkFolder *> vf[SIDES];
+   int s;
+   size_t i;
+
+   for (s = 0; s < SIDES; s++) {
+      for (i = 0; i < groups[s].c; i++) {
+         ExtractFromFolder(groups[s].ppbf[i], vb[s], vf[s]);
+      }
+
+      SortBookmarks(vb[s], m_fEquivalent);
+      SortBookmarkFolders(vf[s]);
+   }
+
+   int r = mergeBookmarks(vb);
+
+   return r + mergeFolders(vf);
+}
+
+/**
+ * Each side's bookmarks are sorted, so equal bookmarks are in a run on
+ * each side and so are same-named ones.  For each bookmark, the merge
+ * has as many as the local side, plus what the remote side added or
+ * less what it removed, but no fewer than none and no more than either
+ * side has.
+ */
+int Merge3::mergeBookmarks(const vector<const Bookmark *> *vb) {
+   size_t i[SIDES] = { 0, 0, 0 };
+   int r = 0;
+   int s;
+
+   // for the name being looked at, a bookmark gone from both sides and
+   // a different one of that name new on each
+   //
+   const Bookmark *pName = NULL;
+   const Bookmark *apNew[SIDES] = { NULL, NULL, NULL };
+
+   for (;;) {
+      const Bookmark *pKey = NULL;
+
+      for (s = 0; s < SIDES; s++) {
+         if (i[s] < vb[s].size() &&
+             (pKey == NULL || BookmarkCompare(vb[s][i[s]], pKey, m_fEquivalent) < 0)) {
+            pKey = vb[s][i[s]];
+         }
+      }
+
+      if (pName != NULL && (pKey == NULL || !pKey->sameName(pName))) {
+         if (apNew[BASE] != NULL && apNew[LOCAL] != NULL && apNew[REMOTE] != NULL) {
+            conflict(apNew[BASE], apNew[LOCAL], apNew[REMOTE]);
+         }
+
+         apNew[BASE] = apNew[LOCAL] = apNew[REMOTE] = NULL;
+      }
+
+      if (pKey == NULL) {
+         break;
+      }
+
+      pName = pKey;
+
+      size_t first[SIDES], n[SIDES];
+
+      for (s = 0; s < SIDES; s++) {
+         first[s] = i[s];
+
+         while (i[s] < vb[s].size() && BookmarkCompare(vb[s][i[s]], pKey, m_fEquivalent) == 0) {
+            i[s]++;
+         }
+
+         n[s] = i[s] - first[s];
+      }
+
+      long cMerged = (long) n[LOCAL] + (long) n[REMOTE] - (long) n[BASE];
+      long cMax = (long) (n[LOCAL] > n[REMOTE] ? n[LOCAL] : n[REMOTE]);
+
+      if (cMerged < 0) {
+         cMerged = 0;
+      }
+      else if (cMerged > cMax) {
+         cMerged = cMax;
+      }
+
+      long k;
+
+      // cMerged > n[LOCAL] only if n[REMOTE] >= cMerged
+      //
+      for (k = (long) n[LOCAL]; k < cMerged; k++) {
+         m_pdiff->addBookmark(vb[REMOTE][first[REMOTE] + k]);
+         r++;
+      }
+
+      for (k = cMerged; k < (long) n[LOCAL]; k++) {
+         m_pdiff->delBookmark(vb[LOCAL][first[LOCAL] + k]);
+         r++;
+      }
+
+      // the side that alone has it, if any
+      //
+      int sOnly = n[BASE] > 0 && n[LOCAL] == 0 && n[REMOTE] == 0 ? BASE :
+                  n[BASE] == 0 && n[LOCAL] > 0 && n[REMOTE] == 0 ? LOCAL :
+                  n[BASE] == 0 && n[LOCAL] == 0 && n[REMOTE] > 0 ? REMOTE : SIDES;
+
+      if (sOnly != SIDES) {
+         apNew[sOnly] = vb[sOnly][first[sOnly]];
+      }
+   }
+
+   return r;
+}
+
+int Merge3::mergeFolders(const vector<const BookmarkFolder *> *vf) {
+   size_t i[SIDES] = { 0, 0, 0 };
+   int r = 0;
+   int s;
+
+   for (;;) {
+      const BookmarkFolder *pKey = NULL;
+
+      for (s = 0; s < SIDES; s++) {
+         if (i[s] < vf[s].size() &&
+             (pKey == NULL || vf[s][i[s]]->getNameAtom().compareIgnoreCase(pKey->getNameAtom()) < 0)) {
+            pKey = vf[s][i[s]];
+         }
+      }
+
+      if (pKey == NULL) {
+         break;
+      }
+
+      Merge3Group groups[SIDES];
+
+      for (s = 0; s < SIDES; s++) {
+         size_t first = i[s];
+
+         while (i[s] < vf[s].size() && vf[s][i[s]]->sameName(pKey)) {
+            i[s]++;
+         }
+
+         groups[s].ppbf = i[s] > first ? &vf[s][first] : NULL;
+         groups[s].c = i[s] - first;
+      }
+
+      const Merge3Group &base = groups[BASE];
+      const Merge3Group &local = groups[LOCAL];
+      const Merge3Group &remote = groups[REMOTE];
+      size_t k;
+
+      if (local.c > 0 && remote.c > 0) {
+         // nothing to bring in if the remote side didn't change, or
+         // made the same changes
+         //
+         if (!unchanged(remote, base) && !unchanged(remote, local)) {
+            m_pdiff->pushFolder(local.first());
+            r += merge(groups);
+            m_pdiff->popFolder();
+         }
+      }
+      else if (local.c > 0) {
+         if (base.c == 0) {
+            // added locally
+         }
+         else if (unchanged(local, base)) {
+            for (k = 0; k < local.c; k++) {
+               m_pdiff->delFolder(local.ppbf[k]);
+               r++;
+            }
+         }
+         else {
+            conflict(base.first(), local.first(), NULL);
+         }
+      }
+      else if (remote.c > 0) {
+         if (base.c > 0 && unchanged(remote, base)) {
+            // deleted locally
+         }
+         else {
+            if (base.c > 0) {
+               conflict(base.first(), NULL, remote.first());
+            }
+
+            for (k = 0; k < remote.c; k++) {
+               m_pdiff->addFolder(remote.ppbf[k]);
+               r++;
+            }
+         }
+      }
+   }
+
+   return r;
+}
+
+int syncit::merge3(const BookmarkFolder *pBase,
+                   const BookmarkFolder *pLocal,
+                   const BookmarkFolder *pRemote,
+                   BookmarkDifferences *pdiff,
+                   BookmarkConflicts *pconflicts,
+                   unsigned flags) {
+   int r = 0;
+
+   if (pRemote->getContentHash() != pBase->getContentHash() &&
+       pRemote->getContentHash() != pLocal->getContentHash()) {
+      Merge3 merge(pdiff, pconflicts, flags);
+      Merge3Group groups[SIDES] = {
+         { &pBase, 1 },
+         { &pLocal, 1 },
+         { &pRemote, 1 }
+      };
+
+      r = merge.merge(groups);
+   }
+
+   pdiff->commit();
+
+   return r;
+}
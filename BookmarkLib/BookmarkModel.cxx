@@ -30,38 +30,88 @@
 #pragma warning( disable : 4786 )
 
 #include <algorithm>
+#include <new>
 
 #include "BookmarkModel.h"
+#include "ProbeTable.h"
+
+#include "SyncLib/Log.h"
 
 using namespace syncit;
 
-BookmarkObject::BookmarkObject() {
-   m_ulRefCount = 1;
+BookmarkObject::BookmarkObject(Kind kind, BookmarkArena *pa) {
+   m_lRefCount = 1;
+   m_kind = (unsigned char) kind;
+   m_parena = pa;
 }
 
-/* virtual */
-BookmarkObject::~BookmarkObject() {
-   assert(m_ulRefCount <= 1);
+// Every BookmarkObject allocated by new is preceded by the arena it
+// came from, or NULL if it came from the heap.
+//
+union NodeHeader {
+   BookmarkArena *pa;
+   double         align;
+};
+
+/* static */
+void *BookmarkObject::operator new(size_t cb) {
+   NodeHeader *p = (NodeHeader *) u_malloc(sizeof(NodeHeader) + cb);
+
+   p->pa = NULL;
+   return p + 1;
 }
 
-/* virtual */
-bool BookmarkObject::isBookmark() const {
-   return false;
+/* static */
+void *BookmarkObject::operator new(size_t cb, BookmarkArena *pa) {
+   if (pa == NULL) {
+      return operator new(cb);
+   }
+
+   NodeHeader *p = (NodeHeader *) pa->allocate(sizeof(NodeHeader) + cb);
+
+   p->pa = pa->attach();
+   return p + 1;
 }
 
-/* virtual */
-bool BookmarkObject::isFolder() const {
-   return false;
+#ifndef NDEBUG
+/* static */
+void *BookmarkObject::operator new(size_t cb, const char *pszSourceFile, unsigned long ulSourceLine) {
+   NodeHeader *p = (NodeHeader *) u_mallocX(sizeof(NodeHeader) + cb, pszSourceFile, ulSourceLine);
+
+   p->pa = NULL;
+   return p + 1;
 }
 
-/* virtual */
-bool BookmarkObject::isAlias() const {
-   return false;
+/* static */
+void BookmarkObject::operator delete(void *pv, const char *pszSourceFile, unsigned long ulSourceLine) {
+   operator delete(pv);
+}
+#endif /* NDEBUG */
+
+/* static */
+void BookmarkObject::operator delete(void *pv) {
+   if (pv != NULL) {
+      NodeHeader *p = (NodeHeader *) pv - 1;
+
+      // arena memory goes when the whole arena does
+      //
+      if (p->pa != NULL) {
+         BookmarkArena::Detach(p->pa);
+      }
+      else {
+         u_free(p);
+      }
+   }
+}
+
+/* static */
+void BookmarkObject::operator delete(void *pv, BookmarkArena *pa) {
+   operator delete(pv);
 }
 
 /* virtual */
-bool BookmarkObject::isSeparator() const {
-   return false;
+BookmarkObject::~BookmarkObject() {
+   assert(m_lRefCount <= 1);
 }
 
 void BookmarkObject::Detach(BookmarkObject *p) {
@@ -75,148 +125,614 @@ bool BookmarkObject::equals(const BookmarkObject *p) const {
    return false;
 }
 
-/* virtual */
-bool BookmarkSeparator::isSeparator() const {
-   return true;
+BookmarkAlias::BookmarkAlias(const BookmarkAlias &rhs) : BookmarkObject(ALIAS) {
+   m_id = allocString(rhs.m_id);
 }
 
-BookmarkAlias::BookmarkAlias(const BookmarkAlias &rhs) {
-   m_id = tstralloc(rhs.m_id);
-}
-
-BookmarkAlias::BookmarkAlias(const tchar_t *pszId) {
-   m_id = tstralloc(pszId);
+BookmarkAlias::BookmarkAlias(const tchar_t *pszId, BookmarkArena *pa) : BookmarkObject(ALIAS, pa) {
+   m_id = allocString(pszId);
 }
 
 BookmarkAlias::~BookmarkAlias() {
-   u_free0(m_id);
+   freeString(m_id);
 }
 
 BookmarkAlias &BookmarkAlias::operator=(const BookmarkAlias &rhs) {
-   m_id = tstrrealloc(m_id, rhs.m_id);
+   m_id = reallocString(m_id, rhs.m_id);
    return *this;
 }
 
-/* virtual */
-bool BookmarkAlias::isAlias() const {
-   return true;
+const DateTime BookmarkItem::gdtNone;
+
+BookmarkItem::Cold::Cold() {
+   pszId = NULL;
+   pszDescription = NULL;
+
+   for (int i = 0; i < NUM_IMAGE_TYPES; i++) {
+      apImages[i] = &Image::Blank;
+   }
 }
 
-BookmarkItem::BookmarkItem(const tchar_t *pszName) {
-   m_pszName = tstralloc(pszName);
-   m_pszId = NULL;
-   m_pszDescription = NULL;
-   m_addTime = 0L;
-   m_images[OPEN_IMAGE] = Image::Blank.attach();
-   m_images[CLOSED_IMAGE] = Image::Blank.attach();
+BookmarkItem::Cold::~Cold() {
+   for (int i = 0; i < NUM_IMAGE_TYPES; i++) {
+      DetachImage(apImages[i]);
+   }
+}
+
+BookmarkItem::BookmarkItem(Kind kind, const tchar_t *pszName, BookmarkArena *pa) : BookmarkObject(kind, pa) {
+   m_name.assign(pszName);
+   m_pcold = NULL;
 }
 
-BookmarkItem::BookmarkItem(const BookmarkItem &rhs) {
-   m_pszName = tstralloc(rhs.m_pszName);
-   m_pszId   = tstralloc(rhs.m_pszId);
-   m_pszDescription = tstralloc(rhs.m_pszDescription);
+BookmarkItem::BookmarkItem(Kind kind, const BookmarkItem &rhs, BookmarkArena *pa) : BookmarkObject(kind, pa) {
+   m_name = rhs.m_name;
+   m_pcold = NULL;
+
+   if (rhs.m_pcold != NULL) {
+      const Cold &c = *rhs.m_pcold;
+      Cold *p = cold();
 
-   m_addTime = rhs.m_addTime;
+      p->pszId = allocString(c.pszId);
+      p->pszDescription = allocString(c.pszDescription);
+      p->added = c.added;
+      p->modified = c.modified;
+      p->visited = c.visited;
 
-   m_images[0] = rhs.m_images[0]->attach();
-   m_images[1] = rhs.m_images[1]->attach();
+      for (int i = 0; i < NUM_IMAGE_TYPES; i++) {
+         p->apImages[i] = AttachImage(c.apImages[i]);
+      }
+   }
 }
 
 /* virtual */
 BookmarkItem::~BookmarkItem() {
-   u_free0(m_pszName);
-   u_free0(m_pszId);
-   u_free0(m_pszDescription);
-
-   Image::Detach(m_images[0]);
-   Image::Detach(m_images[1]);
+   m_name.release();
+   destroyCold();
 }
 
 BookmarkItem &BookmarkItem::operator=(const BookmarkItem &rhs) {
-   m_pszName = tstrrealloc(m_pszName, rhs.m_pszName);
-   m_pszId = tstrrealloc(m_pszId, rhs.m_pszId);
-   m_pszDescription = tstrrealloc(m_pszDescription, rhs.m_pszDescription);
-   m_addTime = rhs.m_addTime;
-   setImages((BookmarkItem::ImageType) 0, rhs.m_images[0]);
-   setImages((BookmarkItem::ImageType) 1, rhs.m_images[1]);
+   if (this != &rhs) {
+      m_name = rhs.m_name;
+
+      if (rhs.m_pcold == NULL) {
+         destroyCold();
+      }
+      else {
+         const Cold &c = *rhs.m_pcold;
+         Cold *p = cold();
+
+         p->pszId = reallocString(p->pszId, c.pszId);
+         p->pszDescription = reallocString(p->pszDescription, c.pszDescription);
+         p->added = c.added;
+         p->modified = c.modified;
+         p->visited = c.visited;
+
+         for (int i = 0; i < NUM_IMAGE_TYPES; i++) {
+            Image *pOld = p->apImages[i];
+
+            p->apImages[i] = AttachImage(c.apImages[i]);
+            DetachImage(pOld);
+         }
+      }
+   }
 
    return *this;
 }
 
+BookmarkItem::Cold *BookmarkItem::cold() {
+   if (m_pcold == NULL) {
+      if (m_parena != NULL) {
+         m_pcold = new(m_parena->allocate(sizeof(Cold))) Cold;
+      }
+      else {
+         m_pcold = NEW Cold;
+      }
+   }
+
+   return m_pcold;
+}
+
+void BookmarkItem::memoryStats(BookmarkMemoryStats &stats, unsigned long cRefs) const {
+   m_name.memoryStats(stats, cRefs);
+
+   if (m_pcold != NULL) {
+      stats.add(BookmarkMemoryStats::NODES, sizeof(Cold), cRefs);
+
+      if (m_pcold->pszId != NULL) {
+         stats.add(BookmarkMemoryStats::STRINGS, (tstrlen(m_pcold->pszId) + 1) * sizeof(tchar_t), cRefs);
+      }
+
+      if (m_pcold->pszDescription != NULL) {
+         stats.add(BookmarkMemoryStats::STRINGS, (tstrlen(m_pcold->pszDescription) + 1) * sizeof(tchar_t), cRefs);
+      }
+   }
+}
+
+void BookmarkItem::destroyCold() {
+   if (m_pcold != NULL) {
+      freeString(m_pcold->pszId);
+      freeString(m_pcold->pszDescription);
+
+      // arena memory goes with the arena
+      //
+      if (m_parena != NULL) {
+         m_pcold->~Cold();
+      }
+      else {
+         delete m_pcold;
+      }
+
+      m_pcold = NULL;
+   }
+}
+
 /* virtual */
 bool BookmarkSubscription::isSubscription() const {
    return true;
 }
 
-BookmarkModel::BookmarkModel() {
+BookmarkAliases::BookmarkAliases(const BookmarkAliases &rhs) {
+   m_pslots = NULL;
+   m_cSlots = 0;
+   m_cUsed = 0;
+
+   operator=(rhs);
+}
+
+BookmarkAliases &BookmarkAliases::operator=(const BookmarkAliases &rhs) {
+   if (this != &rhs) {
+      clear();
+
+      if (rhs.m_cSlots != 0) {
+         m_pslots = NEW Slot[rhs.m_cSlots];
+         m_cSlots = rhs.m_cSlots;
+         m_cUsed = rhs.m_cUsed;
+
+         for (size_t i = 0; i < m_cSlots; i++) {
+            m_pslots[i] = rhs.m_pslots[i];
+         }
+      }
+   }
+
+   return *this;
+}
+
+void BookmarkAliases::clear() {
+   delete[] m_pslots;
+
+   m_pslots = NULL;
+   m_cSlots = 0;
+   m_cUsed = 0;
+}
+
+void BookmarkAliases::memoryStats(BookmarkMemoryStats &stats) const {
+   // the ids are the items' own, counted with them
+   //
+   stats.add(BookmarkMemoryStats::ALIASES, sizeof(*this) + m_cSlots * sizeof(Slot));
+}
+
+struct BookmarkAliases::SlotTraits {
+   bool empty(const Slot &slot) const {
+      return slot.p == NULL;
+   }
+
+   unsigned __int64 hash(const Slot &slot) const {
+      return slot.id.getFoldedHash();
+   }
+
+   void clear(Slot &slot) const {
+      slot.id.release();
+      slot.p = NULL;
+   }
+};
+
+size_t BookmarkAliases::lookup(const tchar_t *psz) const {
+   size_t mask = m_cSlots - 1;
+   size_t i = (size_t) BookmarkName::FoldedHash(psz) & mask;
+
+   while (m_pslots[i].p != NULL && tstrcmp(m_pslots[i].id.c_str(), psz) != 0) {
+      i = (i + 1) & mask;
+   }
+
+   return i;
+}
+
+BookmarkItem *BookmarkAliases::find(const tchar_t *psz) const {
+   return m_cSlots == 0 ? NULL : m_pslots[lookup(psz)].p;
+}
+
+void BookmarkAliases::define(const tchar_t *psz, BookmarkItem *p) {
+   assert(p != NULL);
+
+   // keep the table at most half full
+   //
+   if ((m_cUsed + 1) * 2 > m_cSlots) {
+      grow();
+   }
+
+   Slot &slot = m_pslots[lookup(psz)];
+
+   if (slot.p == NULL) {
+      slot.id.assign(psz);
+      m_cUsed++;
+   }
+
+   slot.p = p;
+}
+
+void BookmarkAliases::remove(const tchar_t *psz) {
+   if (m_cSlots == 0) {
+      return;
+   }
+
+   size_t i = lookup(psz);
+
+   if (m_pslots[i].p == NULL) {
+      return;
+   }
+
+   ProbeErase(m_pslots, m_cSlots, i, SlotTraits());
+   m_cUsed--;
+}
+
+void BookmarkAliases::grow() {
+   Slot *pOld = m_pslots;
+   size_t cOld = m_cSlots;
+
+   m_cSlots = cOld == 0 ? 16 : cOld * 2;
+   m_pslots = NEW Slot[m_cSlots];
+
+   for (size_t i = 0; i < cOld; i++) {
+      if (pOld[i].p != NULL) {
+         m_pslots[ProbeEmpty(m_pslots, m_cSlots, pOld[i].id.getFoldedHash(), SlotTraits())] = pOld[i];
+      }
+   }
+
+   delete[] pOld;
+}
+
+// A model owns the reference to the arena that it passes to its base
+// constructor: every folder and string of the model comes from there.
+//
+BookmarkModel::BookmarkModel() : BookmarkSubscription(NEW BookmarkArena) {
    m_pNewItemHeader = m_pMenuHeader = NULL;
 }
 
-BookmarkModel::BookmarkModel(const BookmarkModel &rhs) : BookmarkSubscription(rhs) {
+// Copies are cheap: the elements are shared, and so are the alias
+// targets among them.
+//
+BookmarkModel::BookmarkModel(const BookmarkModel &rhs) : BookmarkSubscription(rhs, NEW BookmarkArena), m_aliases(rhs.m_aliases) {
    m_pNewItemHeader = m_pMenuHeader = NULL;
-   rebuild(this);
+}
+
+BookmarkModel::~BookmarkModel() {
+   // nodes still holding the arena keep it alive until they go
+   //
+   BookmarkArena::Detach(m_parena);
 }
 
 BookmarkModel &BookmarkModel::operator=(const BookmarkModel &rhs) {
    BookmarkSubscription::operator=(rhs);
 
+   m_aliases = rhs.m_aliases;
    m_pNewItemHeader = m_pMenuHeader = NULL;
-   rebuild(this);
    return *this;
 }
 
-void BookmarkModel::rebuild(BookmarkFolder *pbf) {
-   BookmarkVector::const_iterator i = pbf->begin(), end = pbf->end();
+void BookmarkModel::defineAliasIds(BookmarkItem *p) {
+   if (!p->isFolder()) {
+      if (p->hasId()) {
+         defineAliasId(p->getId(), p);
+      }
+
+      return;
+   }
+
+   BookmarkWalker walker((const BookmarkFolder *) p);
+   BookmarkWalker::Event e;
+
+   while ((e = walker.next()) != BookmarkWalker::END) {
+      BookmarkItem *pbi = (BookmarkItem *) walker.get();
+
+      if (e != BookmarkWalker::LEAVE && (pbi->isBookmark() || pbi->isFolder()) && pbi->hasId()) {
+         defineAliasId(pbi->getId(), pbi);
+      }
+   }
+}
+
+BookmarkObject *BookmarkModel::adopt(const BookmarkObject *p) {
+   BookmarkArena *pa = p->getArena();
+
+   if (pa == NULL || pa == m_parena) {
+      return (BookmarkObject *) p->attach();
+   }
+
+   switch (p->getKind()) {
+   case BookmarkObject::SEPARATOR:
+      return NEW BookmarkSeparator;
+
+   case BookmarkObject::ALIAS:
+      return NEW BookmarkAlias(*(const BookmarkAlias *) p);
+
+   case BookmarkObject::BOOKMARK:
+      return NEW Bookmark(*(const Bookmark *) p);
+
+   default:
+      if (((const BookmarkFolder *) p)->isSubscription()) {
+         BookmarkSubscription *pbs = NEW BookmarkSubscription(*(const BookmarkSubscription *) p);
+
+         adoptElements(pbs);
+         return pbs;
+      }
+
+      return adoptAsFolder((const BookmarkFolder *) p);
+   }
+}
+
+BookmarkFolder *BookmarkModel::adoptAsFolder(const BookmarkFolder *pf) {
+   BookmarkFolder *pbf = NEW BookmarkFolder(*pf);
+
+   adoptElements(pbf);
+   return pbf;
+}
+
+// pbf is a new copy, so it has no index yet to go stale
+//
+void BookmarkModel::adoptElements(BookmarkFolder *pbf) {
+   assert(pbf->m_pindex == NULL);
+
+   BookmarkVector::iterator i = pbf->m_elements.begin(), end = pbf->m_elements.end();
 
    while (i != end) {
-      if ((*i)->isBookmark()) {
-         Bookmark *pb = (Bookmark *) (*i);
+      BookmarkObject *pOld = *i;
 
-         if (pb->hasId()) {
-            defineAliasId(pb->getId(), pb);
-         }
+      *i++ = adopt(pOld);
+      Detach(pOld);
+   }
+}
+
+void BookmarkModel::memoryStats(BookmarkMemoryStats &stats) const {
+   BookmarkWalker walker(this);
+   BookmarkWalker::Event e;
+
+   // the number of references to each open folder, multiplied down
+   // from the root: what is below a shared folder is shared with it
+   //
+   vector<unsigned long> refs;
+
+   stats.add(BookmarkMemoryStats::NODES, sizeof(BookmarkModel) - sizeof(BookmarkSubscription));
+   m_aliases.memoryStats(stats);
+
+   while ((e = walker.next()) != BookmarkWalker::END) {
+      const BookmarkObject *p = walker.get();
+
+      if (e == BookmarkWalker::LEAVE) {
+         refs.pop_back();
+         continue;
       }
-      else if ((*i)->isFolder()) {
-         BookmarkFolder *pf = (BookmarkFolder *) (*i);
 
-         if (pf->hasId()) {
-            defineAliasId(pf->getId(), pf);
-         }
+      unsigned long cRefs = BookmarkMemoryStats::Product(refs.empty() ? 1 : refs.back(), p->refcount());
+
+      switch (p->getKind()) {
+         case BookmarkObject::SEPARATOR:
+            stats.add(BookmarkMemoryStats::NODES, sizeof(BookmarkSeparator), cRefs);
+            break;
+
+         case BookmarkObject::ALIAS:
+            stats.add(BookmarkMemoryStats::NODES, sizeof(BookmarkAlias), cRefs);
+            break;
+
+         case BookmarkObject::BOOKMARK:
+            ((const Bookmark *) p)->memoryStats(stats, cRefs);
+            break;
 
-         rebuild(pf);
+         case BookmarkObject::FOLDER:
+            ((const BookmarkFolder *) p)->memoryStats(stats, cRefs);
+            refs.push_back(cRefs);
+            break;
       }
+   }
+}
 
-      i++;
+void BookmarkMemoryStats::clear() {
+   for (int i = 0; i < NUM_CATEGORIES; i++) {
+      acbShared[i] = acbUnique[i] = 0;
    }
 }
 
-int syncit::CompareBookmarkFolders(const void *p1, const void *p2) {
-   const BookmarkFolder **pd1 = (const BookmarkFolder **) p1;
-   const BookmarkFolder **pd2 = (const BookmarkFolder **) p2;
+void BookmarkMemoryStats::add(Category c, size_t cb, unsigned long cRefs) {
+   if (cRefs > 1) {
+      acbShared[c] += cb / cRefs;
+   }
+   else {
+      acbUnique[c] += cb;
+   }
+}
 
-   return tstricmp((*pd1)->m_pszName, (*pd2)->m_pszName);
+void BookmarkMemoryStats::add(const BookmarkMemoryStats &rhs) {
+   for (int i = 0; i < NUM_CATEGORIES; i++) {
+      acbShared[i] += rhs.acbShared[i];
+      acbUnique[i] += rhs.acbUnique[i];
+   }
 }
 
-/* virtual */
-void BookmarkDifferences::addFolder(const BookmarkFolder *pNew) {
-   add0(pNew);
+size_t BookmarkMemoryStats::getShared() const {
+   size_t cb = 0;
 
-   pushFolder(pNew);
+   for (int i = 0; i < NUM_CATEGORIES; i++) {
+      cb += acbShared[i];
+   }
 
-   BookmarkVector::const_iterator i = pNew->begin(), end = pNew->end();
+   return cb;
+}
 
-   while (i != end) {
-      if ((*i)->isBookmark()) {
-         addBookmark((const Bookmark *) (*i));
+size_t BookmarkMemoryStats::getUnique() const {
+   size_t cb = 0;
+
+   for (int i = 0; i < NUM_CATEGORIES; i++) {
+      cb += acbUnique[i];
+   }
+
+   return cb;
+}
+
+void BookmarkMemoryStats::log(const char *pszWhat) const {
+   static const char *const apszCategories[NUM_CATEGORIES] = {
+      "nodes", "strings", "hrefs", "vectors", "images", "aliases"
+   };
+
+   Log("Memory %s: %lu shared + %lu unique bytes\r\n",
+       pszWhat, (unsigned long) getShared(), (unsigned long) getUnique());
+
+   for (int i = 0; i < NUM_CATEGORIES; i++) {
+      if (acbShared[i] != 0 || acbUnique[i] != 0) {
+         Log("   %s: %lu shared + %lu unique\r\n",
+             apszCategories[i], (unsigned long) acbShared[i], (unsigned long) acbUnique[i]);
       }
-      else if ((*i)->isFolder()) {
-         addFolder((const BookmarkFolder *) (*i));
+   }
+}
+
+BookmarkFolder *BookmarkModel::editFolder(BookmarkPath::const_iterator i, BookmarkPath::const_iterator e) {
+   BookmarkPath found;
+
+   if (!findPath(this, i, e, NULL, found)) {
+      return NULL;
+   }
+
+   return unsharePath(found);
+}
+
+// Find the folder below pbf at the path i..e, trying each folder of the
+// same name in turn, without changing anything.  If pItem is given the
+// folder must hold it, as BookmarkFolder::findRemovable() matches.  On
+// success found ends with pbf and the folders down to it.
+//
+/* static */
+bool BookmarkModel::findPath(const BookmarkFolder *pbf, BookmarkPath::const_iterator i, BookmarkPath::const_iterator e, const BookmarkItem *pItem, BookmarkPath &found) {
+   found.push_back(pbf);
+
+   if (i == e) {
+      if (pItem == NULL || pbf->findRemovable(pItem, NULL) != NULL) {
+         return true;
       }
+   }
+   else {
+      size_t j = 0;
+      BookmarkItem *p;
+
+      while ((p = pbf->nextNamed((*i)->getNameAtom(), j)) != NULL) {
+         if (p->isFolder() && findPath((BookmarkFolder *) p, i + 1, e, pItem, found)) {
+            return true;
+         }
+      }
+   }
+
+   found.pop_back();
+
+   return false;
+}
+
+// Replace each shared folder of found, as findPath() left it, with a
+// private copy.  They are all about to change, or one of their
+// subfolders is, so their hashes go too: see
+// BookmarkFolder::getContentHash().
+//
+BookmarkFolder *BookmarkModel::unsharePath(const BookmarkPath &found) {
+   BookmarkFolder *pbf = this;
+
+   assert(found.front() == this);
+
+   pbf->m_lSummary = 0;
+
+   for (size_t n = 1; n < found.size(); n++) {
+      pbf = unshare(pbf, (BookmarkFolder *) found[n]);
+      pbf->m_lSummary = 0;
+   }
+
+   return pbf;
+}
+
+BookmarkItem *BookmarkModel::removeItem(BookmarkPath::const_iterator i, BookmarkPath::const_iterator e, const BookmarkItem *pItem, BookmarkFolder **ppbfParent) {
+   BookmarkPath found;
 
-      i++;
+   if (!findPath(this, i, e, pItem, found)) {
+      return NULL;
    }
 
-   popFolder();
+   BookmarkFolder *pbf = unsharePath(found);
+   size_t k;
+   BookmarkItem *p = pbf->findRemovable(pItem, &k);
+
+   assert(p != NULL);
+
+   pbf->erase(k);
+   *ppbfParent = pbf;
+
+   return p;
+}
+
+BookmarkFolder *BookmarkModel::unshare(BookmarkFolder *pbfParent, BookmarkFolder *pOld) {
+   if (!pOld->isShared()) {
+      return pOld;
+   }
+
+   // on the heap: see BookmarkArena
+   //
+   BookmarkFolder *pNew = NEW BookmarkFolder(*pOld);
+
+   pbfParent->replace(pOld, pNew);
+
+   // the old folder lives on in the models still sharing it
+   //
+   if (m_pNewItemHeader == pOld) {
+      m_pNewItemHeader = pNew;
+   }
+
+   if (m_pMenuHeader == pOld) {
+      m_pMenuHeader = pNew;
+   }
+
+   if (pNew->hasId()) {
+      defineAliasId(pNew->getId(), pNew);
+   }
+
+   Detach(pOld);
+
+   return pNew;
+}
+
+int syncit::CompareBookmarkFolders(const void *p1, const void *p2) {
+   const BookmarkFolder **pd1 = (const BookmarkFolder **) p1;
+   const BookmarkFolder **pd2 = (const BookmarkFolder **) p2;
+
+   return (*pd1)->getNameAtom().compareIgnoreCase((*pd2)->getNameAtom());
+}
+
+/* virtual */
+void BookmarkDifferences::addFolder(const BookmarkFolder *pNew) {
+   BookmarkWalker walker(pNew);
+   BookmarkWalker::Event e;
+
+   while ((e = walker.next()) != BookmarkWalker::END) {
+      const BookmarkObject *p = walker.get();
+
+      switch (e) {
+         case BookmarkWalker::ENTER:
+            add0((const BookmarkFolder *) p);
+            pushFolder((const BookmarkFolder *) p);
+            break;
+
+         case BookmarkWalker::ITEM:
+            if (p->isBookmark()) {
+               addBookmark((const Bookmark *) p);
+            }
+            break;
+
+         case BookmarkWalker::LEAVE:
+            popFolder();
+            break;
+      }
+   }
 }
 
 /* virtual */
@@ -226,29 +742,65 @@ void BookmarkDifferences::add0(const BookmarkFolder *pOld) {
 
 /* virtual */
 void BookmarkDifferences::delFolder(const BookmarkFolder *pOld) {
-   pushFolder(pOld);
+   BookmarkWalker walker(pOld);
+   BookmarkWalker::Event e;
+
+   while ((e = walker.next()) != BookmarkWalker::END) {
+      const BookmarkObject *p = walker.get();
+
+      switch (e) {
+         case BookmarkWalker::ENTER:
+            pushFolder((const BookmarkFolder *) p);
+            break;
+
+         case BookmarkWalker::ITEM:
+            if (p->isBookmark()) {
+               delBookmark((const Bookmark *) p);
+            }
+            break;
+
+         case BookmarkWalker::LEAVE:
+            popFolder();
+            del0((const BookmarkFolder *) p);
+            break;
+      }
+   }
+}
 
-   BookmarkVector::const_iterator i = pOld->begin(), end = pOld->end();
+/* virtual */
+void BookmarkDifferences::del0(const BookmarkFolder *pOld) {
+   pOld;    // unreferenced
+}
 
-   while (i != end) {
-      if ((*i)->isBookmark()) {
-         delBookmark((const Bookmark *) (*i));
-      }
-      else if ((*i)->isFolder()) {
-         delFolder((const BookmarkFolder *) (*i));
-      }
+/* virtual */
+void BookmarkDifferences::commit() {
+}
 
-      i++;
-   }
+/* virtual */
+void BookmarkDifferences::pushFolderPair(const BookmarkFolder *pbf, const BookmarkFolder *pbfOld) {
+   pushFolder(pbf);
+}
 
-   popFolder();
+/* virtual */
+bool BookmarkDifferences::acceptsMoves() const {
+   return false;
+}
 
-   del0(pOld);
+// not called unless acceptsMoves()
+//
+/* virtual */
+void BookmarkDifferences::moveBookmark(const Bookmark *pNew, const Bookmark *pOld, const BookmarkPath &pathOld) {
+   assert(false);
 }
 
 /* virtual */
-void BookmarkDifferences::del0(const BookmarkFolder *pOld) {
-   pOld;    // unreferenced
+void BookmarkDifferences::moveFolder(const BookmarkFolder *pNew, const BookmarkFolder *pOld, const BookmarkPath &pathOld) {
+   assert(false);
+}
+
+/* virtual */
+void BookmarkDifferences::renameItem(const BookmarkItem *pNew, const BookmarkItem *pOld) {
+   assert(false);
 }
 
 void syncit::ExtractFromFolder(const BookmarkFolder *pbf,
@@ -259,17 +811,29 @@ void syncit::ExtractFromFolder(const BookmarkFolder *pbf,
    while (i != end) {
       const BookmarkObject *pbn = *i++;
 
-      if (pbn->isBookmark()) {
-         const Bookmark *p = (const Bookmark *) pbn;
-         if (p->getName()[0] != '.') {
-            vb.push_back(p);
-         }
+      // a hole left by a removal, see BookmarkFolder::compact()
+      //
+      if (pbn == NULL) {
+         continue;
       }
-      else if (pbn->isFolder()) {
-         const BookmarkFolder *p = (const BookmarkFolder *) pbn;
 
-         if (p->getName()[0] != '.') {
-            vf.push_back((const BookmarkFolder *) pbn);
+      switch (pbn->getKind()) {
+         case BookmarkObject::BOOKMARK: {
+            const Bookmark *p = (const Bookmark *) pbn;
+
+            if (p->getName()[0] != '.') {
+               vb.push_back(p);
+            }
+            break;
+         }
+
+         case BookmarkObject::FOLDER: {
+            const BookmarkFolder *p = (const BookmarkFolder *) pbn;
+
+            if (p->getName()[0] != '.') {
+               vf.push_back(p);
+            }
+            break;
          }
       }
    }
@@ -283,13 +847,15 @@ void syncit::ExtractFromFolder(const BookmarkFolder *pbf,
 static
 int diffBookmarks(const vector<const Bookmark *> &vb1,
                   const vector<const Bookmark *> &vb2,
-                  BookmarkDifferences *pdiff) {
+                  BookmarkDifferences *pdiff,
+                  unsigned flags) {
+   bool fEquivalent = (flags & DIFF_EQUIVALENT_HREFS) != 0;
    int r = 0;
    vector<const Bookmark *>::const_iterator ib1 = vb1.begin(), endb1 = vb1.end(),
                                             ib2 = vb2.begin(), endb2 = vb2.end();
 
    while (ib1 != endb1 && ib2 != endb2) {
-      int c = BookmarkCompare(*ib1, *ib2);
+      int c = BookmarkCompare(*ib1, *ib2, fEquivalent);
 
       if (c == 0) {
          ib1++;
@@ -318,10 +884,211 @@ int diffBookmarks(const vector<const Bookmark *> &vb1,
    return r;
 }
 
+static
+void sortBookmarks(vector<const Bookmark *> &vb, unsigned flags) {
+   SortBookmarks(vb, (flags & DIFF_EQUIVALENT_HREFS) != 0);
+}
+
+struct DiffTask;
+
+typedef vector<const BookmarkFolder *>::const_iterator FolderIterator;
+
+/**
+ * A BookmarkDifferences that keeps the calls made on it, to make them
+ * again on another in the same order.  A subtree left to a DiffTask is
+ * kept as a call to replay that task's recording in its place.
+ */
+class DiffRecording : public BookmarkDifferences {
+public:
+   DiffRecording() {
+   }
+
+   virtual void addBookmark(const Bookmark *pNew) {
+      record(ADD_BOOKMARK, pNew);
+   }
+
+   virtual void delBookmark(const Bookmark *pOld) {
+      record(DEL_BOOKMARK, pOld);
+   }
+
+   virtual void pushFolder(const BookmarkFolder *pbf) {
+      record(PUSH_FOLDER, pbf);
+   }
+
+   virtual void pushFolderPair(const BookmarkFolder *pbf, const BookmarkFolder *pbfOld) {
+      record(PUSH_FOLDER, pbf, pbfOld);
+   }
+
+   virtual void addFolder(const BookmarkFolder *pNew) {
+      record(ADD_FOLDER, pNew);
+   }
+
+   virtual void delFolder(const BookmarkFolder *pOld) {
+      record(DEL_FOLDER, pOld);
+   }
+
+   virtual void popFolder() {
+      record(POP_FOLDER, NULL);
+   }
+
+   void task(const DiffTask *pt) {
+      record(TASK, pt);
+   }
+
+   void replay(BookmarkDifferences *pdiff) const;
+
+   enum Op {
+      ADD_BOOKMARK,
+      DEL_BOOKMARK,
+      PUSH_FOLDER,
+      ADD_FOLDER,
+      DEL_FOLDER,
+      POP_FOLDER,
+      TASK
+   };
+
+   struct Call {
+      Op op;
+      const void *p;
+      const void *pOld;    // the old folder of PUSH_FOLDER, or NULL
+   };
+
+   const vector<Call> &getCalls() const {
+      return m_calls;
+   }
+
+   // make the PUSH_FOLDER call on pdiff
+   //
+   static void PushFolder(BookmarkDifferences *pdiff, const Call &call);
+
+private:
+   void record(Op op, const void *p, const void *pOld = NULL) {
+      Call call = { op, p, pOld };
+
+      m_calls.push_back(call);
+   }
+
+   vector<Call> m_calls;
+};
+
+/**
+ * A group of same-named folders whose diff is put off, to run on a
+ * worker thread or to be split up further.
+ */
+struct DiffTask {
+   vector<const BookmarkFolder *> vf1, vf2;
+   unsigned long cBookmarks;  // in the group, on both sides
+   bool fSplit;               // rec has only its first level
+   DiffRecording rec;
+   int r;
+};
+
+typedef vector<DiffTask *> DiffTasks;
+
+/* static */
+void DiffRecording::PushFolder(BookmarkDifferences *pdiff, const Call &call) {
+   if (call.pOld != NULL) {
+      pdiff->pushFolderPair((const BookmarkFolder *) call.p, (const BookmarkFolder *) call.pOld);
+   }
+   else {
+      pdiff->pushFolder((const BookmarkFolder *) call.p);
+   }
+}
+
+void DiffRecording::replay(BookmarkDifferences *pdiff) const {
+   vector<Call>::const_iterator i = m_calls.begin(), end = m_calls.end();
+
+   for (; i != end; i++) {
+      switch (i->op) {
+         case ADD_BOOKMARK:
+            pdiff->addBookmark((const Bookmark *) i->p);
+            break;
+
+         case DEL_BOOKMARK:
+            pdiff->delBookmark((const Bookmark *) i->p);
+            break;
+
+         case PUSH_FOLDER:
+            PushFolder(pdiff, *i);
+            break;
+
+         case ADD_FOLDER:
+            pdiff->addFolder((const BookmarkFolder *) i->p);
+            break;
+
+         case DEL_FOLDER:
+            pdiff->delFolder((const BookmarkFolder *) i->p);
+            break;
+
+         case POP_FOLDER:
+            pdiff->popFolder();
+            break;
+
+         case TASK:
+            ((const DiffTask *) i->p)->rec.replay(pdiff);
+            break;
+      }
+   }
+}
+
+static
+int diffFolders(const vector<const BookmarkFolder *> &vf1,
+                const vector<const BookmarkFolder *> &vf2,
+                BookmarkDifferences *pdiff,
+                unsigned flags,
+                DiffTasks *ptasks = NULL);
+
+/**
+ * Diff the merged contents of the same-named folders [if1, end1) and
+ * [if2, end2).  With ptasks, the groups of subfolders aren't diffed
+ * but left to new DiffTasks (and pdiff must be a DiffRecording).
+ */
+static
+int diffGroup(FolderIterator if1, FolderIterator end1,
+              FolderIterator if2, FolderIterator end2,
+              BookmarkDifferences *pdiff,
+              unsigned flags,
+              DiffTasks *ptasks) {
+   const BookmarkFolder *pf1 = *if1;
+   const BookmarkFolder *pf2 = *if2;
+   vector<const Bookmark *> b1, b2;
+   vector<const BookmarkFolder *> f1, f2;
+   int r = 0;
+
+   for (; if1 != end1; if1++) {
+      ExtractFromFolder(*if1, b1, f1);
+   }
+
+   for (; if2 != end2; if2++) {
+      ExtractFromFolder(*if2, b2, f2);
+   }
+
+   // diff Bookmarks
+   //
+   sortBookmarks(b1, flags);
+   sortBookmarks(b2, flags);
+
+   pdiff->pushFolderPair(pf1, pf2);
+
+   r += diffBookmarks(b1, b2, pdiff, flags);
+
+   // diff Folders
+   //
+   SortBookmarkFolders(f1);
+   SortBookmarkFolders(f2);
+
+   r += diffFolders(f1, f2, pdiff, flags, ptasks);
+   pdiff->popFolder();
+
+   return r;
+}
+
 static
 int diffFolders(const vector<const BookmarkFolder *> &vf1,
                 const vector<const BookmarkFolder *> &vf2,
-                BookmarkDifferences *pdiff) {
+                BookmarkDifferences *pdiff,
+                unsigned flags,
+                DiffTasks *ptasks) {
    int r = 0;
    vector<const BookmarkFolder *>::const_iterator if1 = vf1.begin(), endf1 = vf1.end(),
                                                   if2 = vf2.begin(), endf2 = vf2.end();
@@ -329,42 +1096,57 @@ int diffFolders(const vector<const BookmarkFolder *> &vf1,
    while (if1 != endf1 && if2 != endf2) {
       const BookmarkFolder *pf1 = *if1;
       const BookmarkFolder *pf2 = *if2;
-      int c = tstricmp(pf1->getName(), pf2->getName());
+      int c = pf1->getNameAtom().compareIgnoreCase(pf2->getNameAtom());
+
+      // a lone folder on each side, with the same contents: there is
+      // nothing to report below it
+      //
+      if (c == 0 &&
+          (if1 + 1 == endf1 || !(*(if1 + 1))->sameName(pf1)) &&
+          (if2 + 1 == endf2 || !(*(if2 + 1))->sameName(pf2)) &&
+          pf1->getContentHash() == pf2->getContentHash()) {
+         if1++;
+         if2++;
+         continue;
+      }
 
       if (c == 0) {
-         vector<const Bookmark *> b1, b2;
-         vector<const BookmarkFolder *> f1, f2;
+         FolderIterator begin1 = if1, begin2 = if2;
 
          do {
-            ExtractFromFolder(*if1, b1, f1);
-
             if1++;
-         } while (if1 != endf1 && EqualsIgnoreCase((*if1)->getName(), pf1->getName()));
+         } while (if1 != endf1 && (*if1)->sameName(pf1));
 
          // if1 == endf1 || if1->title != pf1->title
 
          do {
-            ExtractFromFolder(*if2, b2, f2);
-
             if2++;
-         } while (if2 != endf2 && EqualsIgnoreCase((*if2)->getName(), pf2->getName()));
+         } while (if2 != endf2 && (*if2)->sameName(pf2));
 
-         // diff Bookmarks
-         //
-         sort(b1.begin(), b1.end(), BookmarkLess);
-         sort(b2.begin(), b2.end(), BookmarkLess);
+         if (ptasks != NULL) {
+            DiffTask *pt = NEW DiffTask;
+            FolderIterator i;
 
-         pdiff->pushFolder(pf1);
+            pt->vf1.assign(begin1, if1);
+            pt->vf2.assign(begin2, if2);
+            pt->cBookmarks = 0;
+            pt->fSplit = false;
+            pt->r = 0;
 
-         r += diffBookmarks(b1, b2, pdiff);
+            for (i = begin1; i != if1; i++) {
+               pt->cBookmarks += (*i)->getBookmarkCount();
+            }
 
-         // diff Folders
-         //
-         sort(f1.begin(), f1.end(), BookmarkFolderLess);
-         sort(f2.begin(), f2.end(), BookmarkFolderLess);
+            for (i = begin2; i != if2; i++) {
+               pt->cBookmarks += (*i)->getBookmarkCount();
+            }
 
-         r += diffFolders(f1, f2, pdiff);
-         pdiff->popFolder();
+            ptasks->push_back(pt);
+            ((DiffRecording *) pdiff)->task(pt);
+         }
+         else {
+            r += diffGroup(begin1, if1, begin2, if2, pdiff, flags, NULL);
+         }
       }
       else if (c < 0) {
          pdiff->addFolder(pf1);
@@ -391,9 +1173,454 @@ int diffFolders(const vector<const BookmarkFolder *> &vf1,
    return r;
 }
 
+/**
+ * Whether pf1 and pf2 hold the same bookmarks and folders, as diff()
+ * compares them, rather than just the same content hash: two folders
+ * whose hashes collide mustn't be taken for a move.  Same-named
+ * subfolders are compared in the order sorting leaves them, so equal
+ * folders may occasionally be found different, but never the reverse.
+ */
+static
+bool SameContents(const BookmarkFolder *pf1,
+                  const BookmarkFolder *pf2,
+                  unsigned flags) {
+   bool fEquivalent = (flags & DIFF_EQUIVALENT_HREFS) != 0;
+   vector<const Bookmark *> b1, b2;
+   vector<const BookmarkFolder *> f1, f2;
+   size_t i;
+
+   ExtractFromFolder(pf1, b1, f1);
+   ExtractFromFolder(pf2, b2, f2);
+
+   if (b1.size() != b2.size() || f1.size() != f2.size()) {
+      return false;
+   }
+
+   sortBookmarks(b1, flags);
+   sortBookmarks(b2, flags);
+
+   for (i = 0; i < b1.size(); i++) {
+      if (BookmarkCompare(b1[i], b2[i], fEquivalent) != 0) {
+         return false;
+      }
+   }
+
+   SortBookmarkFolders(f1);
+   SortBookmarkFolders(f2);
+
+   for (i = 0; i < f1.size(); i++) {
+      if (!f1[i]->sameName(f2[i]) || !SameContents(f1[i], f2[i], flags)) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+// a folder pushed while going through a DiffRecording, and the one it
+// was pushed in
+//
+struct PathNode {
+   size_t parent;
+   const BookmarkFolder *pbfOld;    // the old folder it was matched with
+};
+
+static const size_t NO_NODE = (size_t) -1;
+
+// The old folders down to node n: an earlier rename or move can't have
+// changed them, as it could a new folder of the same name.
+//
+static void PathTo(const vector<PathNode> &nodes, size_t n, BookmarkPath &path) {
+   path.clear();
+
+   for (; nodes[n].parent != NO_NODE; n = nodes[n].parent) {
+      path.push_back(nodes[n].pbfOld);
+   }
+
+   reverse(path.begin(), path.end());
+}
+
+/**
+ * Replay rec, which has no tasks, into pdiff, with the deletes paired
+ * to adds of the same item where they can be: see acceptsMoves() in
+ * BookmarkDifferences.  Bookmarks pair on their hrefs, preferring one
+ * of the same name; folders on their content hash, and then only if
+ * they have bookmarks or the same name and SameContents() confirms it.
+ * Returns the number of pairs.
+ */
+static
+int replayMoves(const DiffRecording &rec,
+                BookmarkDifferences *pdiff,
+                unsigned flags) {
+   typedef multimap<unsigned __int64, size_t> Deletes;
+
+   bool fEquivalent = (flags & DIFF_EQUIVALENT_HREFS) != 0;
+   const vector<DiffRecording::Call> &calls = rec.getCalls();
+   size_t c = calls.size();
+   vector<size_t> node(c), paired(c, NO_NODE);
+   vector<PathNode> nodes;
+   Deletes delBookmarks, delFolders;
+   size_t k, n = 0;
+   int cPairs = 0;
+
+   PathNode root = { NO_NODE, NULL };
+
+   nodes.push_back(root);
+
+   // where each call is made, and the deletes by key
+   //
+   for (k = 0; k < c; k++) {
+      const DiffRecording::Call &call = calls[k];
+
+      node[k] = n;
+
+      switch (call.op) {
+         case DiffRecording::PUSH_FOLDER: {
+            PathNode pushed = { n, (const BookmarkFolder *) (call.pOld != NULL ? call.pOld : call.p) };
+
+            n = nodes.size();
+            nodes.push_back(pushed);
+            break;
+         }
+
+         case DiffRecording::POP_FOLDER:
+            n = nodes[n].parent;
+            break;
+
+         case DiffRecording::DEL_BOOKMARK: {
+            const Href &href = ((const Bookmark *) call.p)->getHref();
+
+            delBookmarks.insert(Deletes::value_type(fEquivalent ? href.getEquivalenceHash() : href.getHash(), k));
+            break;
+         }
+
+         case DiffRecording::DEL_FOLDER:
+            delFolders.insert(Deletes::value_type(((const BookmarkFolder *) call.p)->getContentHash(), k));
+            break;
+      }
+   }
+
+   // pair each add with a delete not yet taken
+   //
+   for (k = 0; k < c; k++) {
+      const DiffRecording::Call &call = calls[k];
+      size_t kPair = NO_NODE;
+
+      if (call.op == DiffRecording::ADD_BOOKMARK) {
+         const Bookmark *pNew = (const Bookmark *) call.p;
+         const Href &href = pNew->getHref();
+         pair<Deletes::iterator, Deletes::iterator> range =
+            delBookmarks.equal_range(fEquivalent ? href.getEquivalenceHash() : href.getHash());
+
+         for (; range.first != range.second; range.first++) {
+            size_t j = range.first->second;
+            const Bookmark *pOld = (const Bookmark *) calls[j].p;
+
+            if (paired[j] == NO_NODE &&
+                (fEquivalent ? Href::CompareEquivalent(href, pOld->getHref())
+                             : Href::Compare(href, pOld->getHref())) == 0) {
+               if (kPair == NO_NODE) {
+                  kPair = j;
+               }
+
+               if (pNew->sameName(pOld)) {
+                  kPair = j;
+                  break;
+               }
+            }
+         }
+      }
+      else if (call.op == DiffRecording::ADD_FOLDER) {
+         const BookmarkFolder *pNew = (const BookmarkFolder *) call.p;
+         pair<Deletes::iterator, Deletes::iterator> range =
+            delFolders.equal_range(pNew->getContentHash());
+
+         for (; range.first != range.second; range.first++) {
+            size_t j = range.first->second;
+            const BookmarkFolder *pOld = (const BookmarkFolder *) calls[j].p;
+
+            if (paired[j] == NO_NODE &&
+                pNew->getBookmarkCount() == pOld->getBookmarkCount() &&
+                (pNew->getBookmarkCount() > 0 || pNew->sameName(pOld)) &&
+                SameContents(pNew, pOld, flags)) {
+               if (kPair == NO_NODE) {
+                  kPair = j;
+               }
+
+               if (pNew->sameName(pOld)) {
+                  kPair = j;
+                  break;
+               }
+            }
+         }
+      }
+
+      if (kPair != NO_NODE) {
+         paired[k] = kPair;
+         paired[kPair] = k;
+         cPairs++;
+      }
+   }
+
+   // replay, with a pair reported where its add was
+   //
+   BookmarkPath pathOld;
+
+   for (k = 0; k < c; k++) {
+      const DiffRecording::Call &call = calls[k];
+      size_t j = paired[k];
+
+      switch (call.op) {
+         case DiffRecording::ADD_BOOKMARK:
+            if (j == NO_NODE) {
+               pdiff->addBookmark((const Bookmark *) call.p);
+            }
+            else if (node[j] == node[k]) {
+               pdiff->renameItem((const Bookmark *) call.p, (const Bookmark *) calls[j].p);
+            }
+            else {
+               PathTo(nodes, node[j], pathOld);
+               pdiff->moveBookmark((const Bookmark *) call.p, (const Bookmark *) calls[j].p, pathOld);
+            }
+            break;
+
+         case DiffRecording::ADD_FOLDER:
+            if (j == NO_NODE) {
+               pdiff->addFolder((const BookmarkFolder *) call.p);
+            }
+            else if (node[j] == node[k]) {
+               pdiff->renameItem((const BookmarkFolder *) call.p, (const BookmarkFolder *) calls[j].p);
+            }
+            else {
+               PathTo(nodes, node[j], pathOld);
+               pdiff->moveFolder((const BookmarkFolder *) call.p, (const BookmarkFolder *) calls[j].p, pathOld);
+            }
+            break;
+
+         case DiffRecording::DEL_BOOKMARK:
+            if (j == NO_NODE) {
+               pdiff->delBookmark((const Bookmark *) call.p);
+            }
+            break;
+
+         case DiffRecording::DEL_FOLDER:
+            if (j == NO_NODE) {
+               pdiff->delFolder((const BookmarkFolder *) call.p);
+            }
+            break;
+
+         case DiffRecording::PUSH_FOLDER:
+            DiffRecording::PushFolder(pdiff, call);
+            break;
+
+         case DiffRecording::POP_FOLDER:
+            pdiff->popFolder();
+            break;
+
+         case DiffRecording::TASK:
+            assert(false);
+            break;
+      }
+   }
+
+   return cPairs;
+}
+
+// Fewer bookmarks than this on both sides aren't worth the threads of
+// diff(DIFF_PARALLEL), and a task with fewer isn't worth splitting.
+//
+static const unsigned long PARALLEL_MIN_BOOKMARKS = 2000;
+static const unsigned long PARALLEL_MIN_SPLIT = 500;
+
+// the tasks left for the workers, each of which takes the next one
+// until there are none left
+//
+struct DiffWork {
+   DiffTasks tasks;
+   unsigned flags;
+   volatile LONG lNext;
+};
+
+static DWORD WINAPI diffThreadProc(LPVOID pv) {
+   DiffWork *pw = (DiffWork *) pv;
+   LONG i;
+
+   while ((i = InterlockedIncrement(&pw->lNext)) < (LONG) pw->tasks.size()) {
+      DiffTask *pt = pw->tasks[i];
+
+      pt->r = diffGroup(pt->vf1.begin(), pt->vf1.end(),
+                        pt->vf2.begin(), pt->vf2.end(),
+                        &pt->rec, pw->flags, NULL);
+   }
+
+   return 0;
+}
+
+/**
+ * diff() with DIFF_PARALLEL.  The groups of matched folders are split
+ * into DiffTasks, biggest first, until there are a few for each
+ * processor; the tasks then run at once, each into its own recording,
+ * and the recordings are replayed into pdiff in the order diff() would
+ * have made the calls.  The folders are only read on the other threads:
+ * diff() has summarized both trees by the time this runs.
+ */
+static
+int diffParallel(const BookmarkFolder *pbf1,
+                 const BookmarkFolder *pbf2,
+                 BookmarkDifferences *pdiff,
+                 unsigned flags) {
+   SYSTEM_INFO si;
+
+   GetSystemInfo(&si);
+
+   size_t cThreads = si.dwNumberOfProcessors;
+
+   if (cThreads > MAXIMUM_WAIT_OBJECTS) {
+      cThreads = MAXIMUM_WAIT_OBJECTS;
+   }
+
+   DiffRecording top;
+   DiffTasks all;
+   vector<const Bookmark *> b1, b2;
+   vector<const BookmarkFolder *> f1, f2;
+   size_t k;
+
+   ExtractFromFolder(pbf1, b1, f1);
+   ExtractFromFolder(pbf2, b2, f2);
+
+   sortBookmarks(b1, flags);
+   sortBookmarks(b2, flags);
+
+   int r = diffBookmarks(b1, b2, &top, flags);
+
+   SortBookmarkFolders(f1);
+   SortBookmarkFolders(f2);
+
+   r += diffFolders(f1, f2, &top, flags, &all);
+
+   // split the biggest task a level down while there are few
+   //
+   size_t cLeft = all.size();
+
+   while (cLeft < 4 * cThreads) {
+      DiffTask *ptBig = NULL;
+
+      for (k = 0; k < all.size(); k++) {
+         DiffTask *pt = all[k];
+
+         if (!pt->fSplit && pt->cBookmarks >= PARALLEL_MIN_SPLIT &&
+             (ptBig == NULL || pt->cBookmarks > ptBig->cBookmarks)) {
+            ptBig = pt;
+         }
+      }
+
+      if (ptBig == NULL) {
+         break;
+      }
+
+      size_t cAll = all.size();
+
+      ptBig->r = diffGroup(ptBig->vf1.begin(), ptBig->vf1.end(),
+                           ptBig->vf2.begin(), ptBig->vf2.end(),
+                           &ptBig->rec, flags, &all);
+      ptBig->fSplit = true;
+
+      cLeft += all.size() - cAll;
+      cLeft--;
+   }
+
+   DiffWork work;
+
+   for (k = 0; k < all.size(); k++) {
+      if (!all[k]->fSplit) {
+         work.tasks.push_back(all[k]);
+      }
+   }
+
+   work.flags = flags;
+   work.lNext = -1;
+
+   // this thread is one of the workers; if a thread can't be had, the
+   // others do its share
+   //
+   vector<HANDLE> threads;
+
+   for (k = 1; k < cThreads && k < work.tasks.size(); k++) {
+      DWORD dwThreadId;
+      HANDLE h = CreateThread(NULL,              // lpSecurityAttributes
+                              0,                 // dwStackSize
+                              diffThreadProc,    // pfnStartAddress
+                              &work,             // pvParameter
+                              0,                 // dwCreationFlags
+                              &dwThreadId);      // pdwThreadId
+
+      if (h == NULL) {
+         break;
+      }
+
+      threads.push_back(h);
+   }
+
+   diffThreadProc(&work);
+
+   if (!threads.empty()) {
+      WaitForMultipleObjects((DWORD) threads.size(), &threads[0], TRUE, INFINITE);
+
+      for (k = 0; k < threads.size(); k++) {
+         CloseHandle(threads[k]);
+      }
+   }
+
+   top.replay(pdiff);
+
+   for (k = 0; k < all.size(); k++) {
+      r += all[k]->r;
+      delete all[k];
+   }
+
+   return r;
+}
+
 int syncit::diff(const BookmarkFolder *pbf1,
                  const BookmarkFolder *pbf2,
-                 BookmarkDifferences *pdiff) {
+                 BookmarkDifferences *pdiff,
+                 unsigned flags) {
+
+   if (pbf1->getContentHash() == pbf2->getContentHash()) {
+      pdiff->commit();
+      return 0;
+   }
+
+   // diff into a recording, whose tasks are replayed into it in order,
+   // and then look for moves in that
+   //
+   if ((flags & DIFF_DETECT_MOVES) && pdiff->acceptsMoves()) {
+      DiffRecording rec;
+      int r = diff(pbf1, pbf2, &rec, flags & ~DIFF_DETECT_MOVES);
+
+      r -= replayMoves(rec, pdiff, flags);
+
+      pdiff->commit();
+
+      return r;
+   }
+
+   if (flags & DIFF_HASH_JOIN) {
+      int r = HashJoinDiff(pbf1, pbf2, pdiff, flags);
+
+      pdiff->commit();
+
+      return r;
+   }
+
+   if ((flags & DIFF_PARALLEL) &&
+       pbf1->getBookmarkCount() + pbf2->getBookmarkCount() >= PARALLEL_MIN_BOOKMARKS) {
+      int r = diffParallel(pbf1, pbf2, pdiff, flags);
+
+      pdiff->commit();
+
+      return r;
+   }
 
    vector<const Bookmark *> b1, b2;
    vector<const BookmarkFolder *> f1, f2;
@@ -403,19 +1630,19 @@ int syncit::diff(const BookmarkFolder *pbf1,
 
    // diff Bookmarks
    //
-   sort(b1.begin(), b1.end(), BookmarkLess);
-   sort(b2.begin(), b2.end(), BookmarkLess);
+   sortBookmarks(b1, flags);
+   sortBookmarks(b2, flags);
 
-   int r = diffBookmarks(b1, b2, pdiff);
+   int r = diffBookmarks(b1, b2, pdiff, flags);
 
    // diff Folders
    //
-   sort(f1.begin(), f1.end(), BookmarkFolderLess);
-   sort(f2.begin(), f2.end(), BookmarkFolderLess);
+   SortBookmarkFolders(f1);
+   SortBookmarkFolders(f2);
 
-   r += diffFolders(f1, f2, pdiff);
+   r += diffFolders(f1, f2, pdiff, flags);
 
-   //pdiff->commit();
+   pdiff->commit();
 
    return r;
 }
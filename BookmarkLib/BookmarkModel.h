@@ -44,6 +44,7 @@
 #include <windows.h>
 
 #include <cassert>
+#include <climits>
 
 #include <vector>
 #include <stack>
@@ -54,15 +55,20 @@
 #include "SyncLib/DateTime.h"
 #include "SyncLib/text.h"
 #include "SyncLib/Image.h"
+#include "SyncLib/CriticalSection.h"
 
 namespace syncit {
 
    using std::vector;
 
+   class PrintWriter;
+
    ///////////////////////
    // Table of Contents...
    //
    class Href;
+   class BookmarkArena;
+   class BookmarkName;
    class BookmarkObject;
    class    BookmarkSeparator;
    class    BookmarkAlias;
@@ -74,55 +80,156 @@ namespace syncit {
    class BookmarkDifferences;
    class BookmarkSink;
    class BookmarkContext;
+   struct BookmarkMemoryStats;
    //
    // ...table of contents
    ///////////////////////
 
+   /**
+    * Bytes of memory used by bookmark state, by category.  Memory with
+    * several references (shared folders, interned names and Hrefs) is
+    * split evenly between them and reported as shared, so that adding
+    * up the stats of several models doesn't count it more than once.
+    * Memory with a single reference is reported as unique.
+    */
+   struct BookmarkMemoryStats {
+      enum Category {
+         NODES,         // BookmarkObjects and their side records
+         STRINGS,       // names, ids, descriptions
+         HREFS,         // Href data and hosts
+         VECTORS,       // folder elements and indexes, intern tables
+         IMAGES,
+         ALIASES,       // alias id tables
+         NUM_CATEGORIES
+      };
+
+      BookmarkMemoryStats() {
+         clear();
+      }
+
+      void clear();
+
+      // cb bytes, referenced cRefs times in all
+      //
+      void add(Category c, size_t cb, unsigned long cRefs = 1);
+
+      void add(const BookmarkMemoryStats &rhs);
+
+      // references to something held cRefs1 times by a holder that is
+      // itself held cRefs2 times
+      //
+      static unsigned long Product(unsigned long cRefs1, unsigned long cRefs2) {
+         return cRefs2 > 1 && cRefs1 > ULONG_MAX / cRefs2 ? ULONG_MAX : cRefs1 * cRefs2;
+      }
+
+      size_t getShared() const;
+      size_t getUnique() const;
+
+      // one line per category to the log, headed by pszWhat
+      //
+      void log(const char *pszWhat) const;
+
+      size_t acbShared[NUM_CATEGORIES];
+      size_t acbUnique[NUM_CATEGORIES];
+   };
+
    /**
     * A Href is a smart pointer to a web URL.  The idea is this: an Href is nothing
     * more than a pointer to a compressed, reference-counted URL.
     */
    class Href {
 
-      friend class Compare;
+      // Common header of everything kept in a Table
+      //
+      struct Entry {
+         unsigned __int64 hash;  // precomputed by init(), used by the Table
+         volatile LONG refcount; // InterlockedXxx only
+      };
 
-      struct Data {
-         unsigned short flags;
+      // A host name, less any "www." prefix and .com/.net/.org suffix.
+      // Hosts are always interned and shared by every Data on that host.
+      //
+      struct Host : Entry {
+         unsigned short flags;   // WWW_MASK | DOMAIN_MASK bits only
+         unsigned short cch;     // host is ach[0..cch), then a 0
          char ach[2];
       };
 
-      class Compare {
-      public:
-         bool operator()(const Data *p1, const Data *p2) const {
-            return Href::Compare0(p1, p2) < 0;
-         }
+      struct Data : Entry {
+         Host *phost;            // holds a reference
+         Data *pcanon;           // canonical equivalent, this if canonical,
+                                 // else holds a reference
+         unsigned short flags;   // PROTOCOL_MASK | INTERNED_MASK bits only
+         unsigned short cchPath; // path is ach[0..cchPath), then a 0
+         char ach[2];
       };
 
       enum {
          PROTOCOL_MASK  = 0xE000,   // 1110 0000
          WWW_MASK       = 0x1000,   // 0001 0000   host prefixed with "www."
          DOMAIN_MASK    = 0x0C00,   // 0000 1100
-         INTERNED_MASK  = 0x0200,   // 0000 0010
-         REFCOUNT_MASK  = 0x01FF    // 0000 0001 1111 1111
+         INTERNED_MASK  = 0x0200    // 0000 0010
+      };
+
+      enum {
+         SHARDS         = 16        // number of Tables, a power of two
       };
 
       Href(Data *p) : m_p(Attach(p)) {
       }
 
-   public:
-      typedef set<Data *, Compare> Set;
-
-   private:
+      /**
+       * A Table is one shard of the set of all interned Href Data (or
+       * Hosts).  It is an open-addressing hash table (linear probing)
+       * keyed on the hash stored in each Entry, so an Intern() lookup
+       * costs one hash computation and, almost always, a single string
+       * comparison.  Callers must hold the Table's lock.
+       */
       class Table {
       public:
-#ifndef NDEBUG
+         Table();
          ~Table();
-#endif /* NDEBUG */
 
-      public:
-         Set m_set;
+         void enter() {
+            m_cs.enter();
+         }
+
+         void leave() {
+            m_cs.leave();
+         }
+
+         Entry *find(const Entry *pe, int (*pfnCompare)(const Entry *, const Entry *)) const;
+         void insert(Entry *pe);
+         void erase(const Entry *pe);
+
+         // bytes of the slot array
+         //
+         size_t getMemorySize() const {
+            return m_cSlots * sizeof(Entry *);
+         }
+
+      private:
+         struct SlotTraits;   // see ProbeTable.h
+
+         void grow();
+
+         CriticalSection m_cs;
+         Entry **m_ppe;    // m_cSlots entries, NULL for an empty slot
+         size_t m_cSlots;  // zero or a power of two
+         size_t m_cUsed;
       };
 
+      // Interned entries are spread across SHARDS Tables by hash, so
+      // threads interning different URLs rarely contend for a lock.
+      //
+      static Table &GetTable(Table *ptables, const Entry *pe) {
+         return ptables[(size_t) (pe->hash >> 32) & (SHARDS - 1)];
+      }
+
+      // BookmarkName atoms are interned with the same Tables
+      //
+      friend class BookmarkName;
+
    public:
       // Create an empty Href.
       //
@@ -182,21 +289,34 @@ namespace syncit {
       static Href Intern(const char *psz);
 
       size_t getHost(char *pach, size_t cch) const {
-         return getHost0(pach, cch, lstrlenA(m_p->ach));
+         return getHost0(pach, cch);
+      }
+
+      // Do both Hrefs point to the same host?  Hosts are interned, so
+      // this is a pointer comparison.
+      //
+      bool sameHost(const Href &rhs) const {
+         return m_p->phost == rhs.m_p->phost;
       }
 
       const char *getPath() const {
-         return m_p->ach + lstrlenA(m_p->ach) + 1;
+         return m_p->ach;
+      }
+
+      size_t getPathLength() const {
+         return m_p->cchPath;
       }
 
       size_t format(char *pach, size_t cch) const;
 
-      static const Set &GetSet() {
-         return m_gtable.m_set;
-      }
+      // Write the URL straight to a PrintWriter, as format() would
+      // produce it.  If pszEscape isn't NULL, every chEscape in the URL
+      // is written as pszEscape instead.
+      //
+      void write(PrintWriter &w, char chEscape = 0, const char *pszEscape = NULL) const;
 
       int getWWW() const {
-         return m_p->flags & WWW_MASK;
+         return m_p->phost->flags & WWW_MASK;
       }
 
       Protocol getProtocol() const {
@@ -204,7 +324,7 @@ namespace syncit {
       }
 
       Domain getDomain() const {
-         return Domain(m_p->flags & DOMAIN_MASK);
+         return Domain(m_p->phost->flags & DOMAIN_MASK);
       }
 
       static int Compare(const Href &lhs, const Href &rhs) {
@@ -213,6 +333,49 @@ namespace syncit {
 
       static int Compare0(const Data *pd1, const Data *pd2);
 
+      // Compare the canonical forms of two Hrefs: host case, an explicit
+      // default port, a trailing slash and the case of %-escapes are
+      // ignored for http, https and ftp URLs.
+      //
+      static int CompareEquivalent(const Href &lhs, const Href &rhs) {
+         return lhs.m_p->pcanon == rhs.m_p->pcanon ? 0 : Compare0(lhs.m_p->pcanon, rhs.m_p->pcanon);
+      }
+
+      bool equivalent(const Href &rhs) const {
+         return m_p->pcanon == rhs.m_p->pcanon;
+      }
+
+      // hash of the URL as it stands, equal for equal Hrefs
+      //
+      unsigned __int64 getHash() const {
+         return m_p->hash;
+      }
+
+      // This Href's share of its data, for a holder referenced cRefs
+      // times.  MemoryStats() adds the intern tables.
+      //
+      void memoryStats(BookmarkMemoryStats &stats, unsigned long cRefs = 1) const;
+      static void MemoryStats(BookmarkMemoryStats &stats);
+
+      // hash of the canonical form, equal for equivalent Hrefs
+      //
+      unsigned __int64 getEquivalenceHash() const {
+         return m_p->pcanon->hash;
+      }
+
+      // splitmix64's finalizer: every bit of h affects every bit of the
+      // result, so sums of mixed element hashes don't cancel out
+      //
+      static unsigned __int64 Mix(unsigned __int64 h) {
+         h ^= h >> 30;
+         h *= 0xBF58476D1CE4E5B9ui64;
+         h ^= h >> 27;
+         h *= 0x94D049BB133111EBui64;
+         h ^= h >> 31;
+
+         return h;
+      }
+
 
    private:
       static Data *Attach(Data *p);
@@ -223,23 +386,237 @@ namespace syncit {
       //
       void release();
 
-      size_t getHost0(char *pach, size_t cch, size_t l) const;
+      size_t getHost0(char *pach, size_t cch) const;
 
-      static size_t init(Data *p, const char *psz);
+      // memcmp() ordering of two counted strings, shorter first on a tie
+      //
+      static int CompareBytes(const char *pach1, size_t cch1, const char *pach2, size_t cch2);
+
+      static int CompareHost(const Host *ph1, const Host *ph2);
+      static int CompareEntry(const Entry *pe1, const Entry *pe2);
+      static int CompareHostEntry(const Entry *pe1, const Entry *pe2);
+
+      // Parse psz into a Host and a Data, returning the size of the
+      // Data; the size of the Host is returned in cbHost.  Data::phost
+      // and Data::hash are left for the caller to fill in.
+      //
+      static size_t init(Data *pd, Host *ph, size_t &cbHost, const char *psz);
+
+      static Host *InternHost(const Host *ph, size_t cb);
+
+      // Release one reference to pd, and delete it if it was the last.
+      //
+      static void Release(Data *pd);
+
+      // Drop a reference to an interned Entry.  Returns true if that was
+      // the last one: the entry has then been erased from the table and
+      // must be deleted by the caller.
+      //
+      static bool Release0(Entry *pe, Table &table);
 
-      unsigned refcount() const {
-         return m_p->flags & REFCOUNT_MASK;
+      // FNV-1a hash continuing from h over cb bytes
+      //
+      static unsigned __int64 Hash(unsigned __int64 h, const void *pv, size_t cb);
+
+      unsigned long refcount() const {
+         return m_p->refcount;
       }
 
    private:
-      static Table m_gtable;
+      static Table m_gtables[SHARDS];
+      static Table m_ghosts[SHARDS];
 
       Data *m_p;  // refcount > 0
    };
 
+   /**
+    * A BookmarkArena hands out memory for the nodes of one BookmarkModel
+    * and for their strings.  Memory is bump-allocated from large chunks
+    * and never freed piece by piece: all the chunks are released together
+    * once the model and every node allocated from the arena are gone.
+    * <p>
+    * The model holds one reference, and every node allocated with
+    * new(pa) holds another.  Copies of a model share its nodes, so
+    * references may be dropped by any thread; allocate() is only called
+    * by whoever is building the model.
+    * <p>
+    * Only building a model, e.g. by parsing, allocates from its arena.
+    * Edits to a model allocate from the heap, since arena memory that
+    * they free isn't reclaimed, and nodes added from another model are
+    * copied (see BookmarkModel::adopt()) so they don't keep all of its
+    * arena alive.
+    */
+   class BookmarkArena {
+   public:
+      BookmarkArena();
+
+      BookmarkArena *attach() {
+         InterlockedIncrement(&m_lRefCount);
+         return this;
+      }
+
+      static void Detach(BookmarkArena *p);
+
+      void *allocate(size_t cb);
+      tchar_t *stralloc(const tchar_t *psz);
+
+   private:
+      ~BookmarkArena();
+
+      struct Chunk {
+         Chunk *pNext;
+         size_t cbFree;
+         char  *pFree;
+      };
+
+      enum {
+         CHUNK_SIZE = 64 * 1024
+      };
+
+      Chunk *newChunk(size_t cb);
+
+      Chunk *m_pChunks;    // the first chunk is the one being filled
+      volatile LONG m_lRefCount;
+
+      // disable copy constructor and assignment
+      BookmarkArena(const BookmarkArena &rhs);
+      BookmarkArena &operator=(const BookmarkArena &rhs);
+   };
+
+   /**
+    * A BookmarkName is the name of a BookmarkItem: a smart pointer to a
+    * process-wide, refcounted atom, interned like Href Data.  Equal
+    * names share one atom across every model the client keeps (the
+    * server copy, the merged copy, the browser backups, the menu).
+    * <p>
+    * An atom also keeps the name's case-folded form (Character::toUpper,
+    * as tstricmp uses) and a hash of it, so case-insensitive equality is
+    * a pointer or hash check in the common case.
+    */
+   class BookmarkName {
+   public:
+      BookmarkName() {
+         m_p = NULL;
+      }
+
+      BookmarkName(const BookmarkName &rhs) {
+         m_p = Attach(rhs.m_p);
+      }
+
+      ~BookmarkName() {
+         release();
+      }
+
+      BookmarkName &operator=(const BookmarkName &rhs) {
+         Atom *p = Attach(rhs.m_p);
+
+         release();
+         m_p = p;
+         return *this;
+      }
+
+      // Intern psz, NULL for no name.
+      //
+      void assign(const tchar_t *psz);
+
+      void release();
+
+      bool isNull() const {
+         return m_p == NULL;
+      }
+
+      const tchar_t *c_str() const {
+         return m_p != NULL ? m_p->ach : NULL;
+      }
+
+      size_t length() const {
+         return m_p != NULL ? m_p->cch : 0;
+      }
+
+      // The upper-cased name, what tstricmp compares.
+      //
+      const tchar_t *folded() const {
+         return m_p != NULL ? m_p->ach + m_p->cch + 1 : NULL;
+      }
+
+      // Hash of folded(), equal for names that are EqualsIgnoreCase.
+      //
+      unsigned __int64 getFoldedHash() const {
+         return m_p != NULL ? m_p->hash : 0;
+      }
+
+      // The same hash for a name that isn't interned.
+      //
+      static unsigned __int64 FoldedHash(const tchar_t *psz);
+
+      // The first few folded characters, packed so that names with
+      // different keys compare (ignoring case) as their keys do.  Equal
+      // keys need compareIgnoreCase() to decide.
+      //
+      unsigned __int64 getSortKey() const {
+         return m_p != NULL ? m_p->key : 0;
+      }
+
+      // Same name, same case.
+      //
+      bool operator==(const BookmarkName &rhs) const {
+         return m_p == rhs.m_p;
+      }
+
+      bool operator!=(const BookmarkName &rhs) const {
+         return m_p != rhs.m_p;
+      }
+
+      bool equalsIgnoreCase(const BookmarkName &rhs) const;
+
+      // Orders names exactly as tstricmp does, by their sort keys when
+      // they differ.  NULL names are not allowed.
+      //
+      int compareIgnoreCase(const BookmarkName &rhs) const;
+
+      // as Href::memoryStats() and Href::MemoryStats()
+      //
+      void memoryStats(BookmarkMemoryStats &stats, unsigned long cRefs = 1) const;
+      static void MemoryStats(BookmarkMemoryStats &stats);
+
+   private:
+      // The name is ach[0..cch), then a 0, then the folded name and a 0.
+      //
+      struct Atom : Href::Entry {
+         unsigned __int64 key;   // see getSortKey()
+         size_t cch;
+         tchar_t ach[2];
+      };
+
+      static Atom *Attach(Atom *p) {
+         if (p != NULL) {
+            InterlockedIncrement(&p->refcount);
+         }
+         return p;
+      }
+
+      static int CompareEntry(const Href::Entry *pe1, const Href::Entry *pe2);
+
+      Atom *m_p;
+
+      static Href::Table m_gtables[Href::SHARDS];
+   };
+
    class BookmarkObject {
+   public:
+      /**
+       * What a BookmarkObject is, so traversals can switch on the kind
+       * instead of making a virtual call per test.
+       */
+      enum Kind {
+         SEPARATOR,
+         ALIAS,
+         BOOKMARK,
+         FOLDER         // includes subscriptions and models
+      };
+
    protected:
-      BookmarkObject();
+      BookmarkObject(Kind kind, BookmarkArena *pa = NULL);
       BookmarkObject &operator=(const BookmarkObject &rhs) {
          return *this;
       }
@@ -247,10 +624,32 @@ namespace syncit {
    public:
       virtual ~BookmarkObject();
 
-      virtual bool isBookmark() const;
-      virtual bool isFolder()   const;
-      virtual bool isAlias()    const;
-      virtual bool isSeparator() const;
+      // BookmarkObjects are allocated either from the heap, by plain
+      // new (or NEW), or from a BookmarkArena by new(pa).  Pass the same
+      // arena to the constructor so strings come from there too.
+      //
+      static void *operator new(size_t cb);
+      static void *operator new(size_t cb, BookmarkArena *pa);
+      static void operator delete(void *pv);
+      static void operator delete(void *pv, BookmarkArena *pa);
+
+#ifndef NDEBUG
+      static void *operator new(size_t cb, const char *pszSourceFile, unsigned long ulSourceLine);
+      static void operator delete(void *pv, const char *pszSourceFile, unsigned long ulSourceLine);
+#endif /* NDEBUG */
+
+      BookmarkArena *getArena() const {
+         return m_parena;
+      }
+
+      Kind getKind() const {
+         return Kind(m_kind);
+      }
+
+      bool isBookmark() const  { return m_kind == BOOKMARK; }
+      bool isFolder() const    { return m_kind == FOLDER; }
+      bool isAlias() const     { return m_kind == ALIAS; }
+      bool isSeparator() const { return m_kind == SEPARATOR; }
 
       virtual bool equals(const BookmarkObject *p) const;
 
@@ -258,19 +657,58 @@ namespace syncit {
          return (const BookmarkObject *) ((BookmarkObject *) this)->attach();
       }
 
+      // Shared objects may be attached and detached by several threads
+      // at once, e.g. when one of them diffs a snapshot of a model that
+      // another is editing.  The Interlocked calls are full barriers, so
+      // whatever a thread did to an object happens before its last
+      // reference goes.
+      //
       BookmarkObject *attach() {
-         m_ulRefCount++;
+         InterlockedIncrement(&m_lRefCount);
          return this;
       }
 
       bool detach() {
-         return --m_ulRefCount == 0;
+         return InterlockedDecrement(&m_lRefCount) == 0;
+      }
+
+      // Referenced from more than one place, e.g. a folder that belongs
+      // to several models: it must be copied, not changed.
+      //
+      bool isShared() const {
+         return m_lRefCount > 1;
+      }
+
+      // only a snapshot, for memory accounting
+      //
+      unsigned long refcount() const {
+         return m_lRefCount;
       }
 
       static void Detach(BookmarkObject *p);
 
+   protected:
+      // Strings belonging to this object, from its arena if it has one.
+      //
+      tchar_t *allocString(const tchar_t *psz) const {
+         return m_parena != NULL ? m_parena->stralloc(psz) : tstralloc(psz);
+      }
+
+      tchar_t *reallocString(tchar_t *pszOld, const tchar_t *psz) const {
+         return m_parena != NULL ? m_parena->stralloc(psz) : tstrrealloc(pszOld, psz);
+      }
+
+      void freeString(tchar_t *psz) const {
+         if (m_parena == NULL) {
+            u_free0(psz);
+         }
+      }
+
+      BookmarkArena *m_parena; // where strings come from, NULL for the heap
+
    private:
-      unsigned long m_ulRefCount;
+      volatile LONG m_lRefCount;
+      unsigned char m_kind;
 
       // disable copy constructor
       BookmarkObject(BookmarkObject &rhs);
@@ -278,22 +716,18 @@ namespace syncit {
 
    class BookmarkSeparator : public BookmarkObject {
    public:
-      BookmarkSeparator() {}
-
-      virtual bool isSeparator() const;
+      BookmarkSeparator(BookmarkArena *pa = NULL) : BookmarkObject(SEPARATOR, pa) {}
    };
 
    class BookmarkAlias : public BookmarkObject {
 
    public:
-      BookmarkAlias(const tchar_t *pszId);
+      BookmarkAlias(const tchar_t *pszId, BookmarkArena *pa = NULL);
       BookmarkAlias(const BookmarkAlias &rhs);
       ~BookmarkAlias();
 
       BookmarkAlias &operator=(const BookmarkAlias &rhs);
 
-      virtual bool isAlias() const;
-
       ////////////////
       // Attributes...
       //
@@ -309,8 +743,8 @@ namespace syncit {
 
    class BookmarkItem : public BookmarkObject {
    protected:
-      BookmarkItem(const tchar_t *pszName);
-      BookmarkItem(const BookmarkItem &rhs);
+      BookmarkItem(Kind kind, const tchar_t *pszName, BookmarkArena *pa);
+      BookmarkItem(Kind kind, const BookmarkItem &rhs, BookmarkArena *pa);
 
       BookmarkItem &operator=(const BookmarkItem &rhs);
 
@@ -324,7 +758,7 @@ namespace syncit {
       // The name property...
       //
       bool hasName() const {
-         return m_pszName != NULL;
+         return !m_name.isNull();
       }
 
       /**
@@ -340,11 +774,27 @@ namespace syncit {
        * @return the current value of the name property
        */
       const tchar_t *getName() const {
-         return m_pszName;
+         return m_name.c_str();
+      }
+
+      size_t getNameLength() const {
+         return m_name.length();
       }
 
       void setName(const tchar_t *pszName) {
-         m_pszName = tstrrealloc(m_pszName, pszName);
+         m_name.assign(pszName);
+      }
+
+      const BookmarkName &getNameAtom() const {
+         return m_name;
+      }
+
+      /**
+       * Case-insensitive name comparison, as EqualsIgnoreCase() but
+       * usually decided by the name atoms alone.
+       */
+      bool sameName(const BookmarkItem *p) const {
+         return m_name.equalsIgnoreCase(p->m_name);
       }
       //
       // ...the name property
@@ -354,15 +804,19 @@ namespace syncit {
       // The ALIASID property...
       //
       bool hasId() const {
-         return m_pszId != NULL;
+         return m_pcold != NULL && m_pcold->pszId != NULL;
       }
 
       const tchar_t *getId() const {
-         return m_pszId;
+         return m_pcold != NULL ? m_pcold->pszId : NULL;
       }
 
       void setId(const tchar_t *psz) {
-         m_pszId = tstrrealloc(m_pszId, psz);
+         if (psz != NULL || m_pcold != NULL) {
+            Cold *p = cold();
+
+            p->pszId = reallocString(p->pszId, psz);
+         }
       }
       // ... the id property
       //////////////////////
@@ -371,15 +825,19 @@ namespace syncit {
       // The description property...
       //
       bool hasDescription() const {
-         return m_pszDescription != NULL;
+         return m_pcold != NULL && m_pcold->pszDescription != NULL;
       }
 
       const tchar_t *getDescription() const {
-         return m_pszDescription;
+         return m_pcold != NULL ? m_pcold->pszDescription : NULL;
       }
 
       void setDescription(const tchar_t *psz) {
-         m_pszDescription = tstrrealloc(m_pszDescription, psz);
+         if (psz != NULL || m_pcold != NULL) {
+            Cold *p = cold();
+
+            p->pszDescription = reallocString(p->pszDescription, psz);
+         }
       }
       // ...the description property
       //////////////////////////////
@@ -388,11 +846,13 @@ namespace syncit {
       // The addTime property...
       //
       const DateTime &getAdded() const {
-         return m_addTime;
+         return m_pcold != NULL ? m_pcold->added : gdtNone;
       }
 
       void setAdded(const DateTime &dt) {
-         m_addTime = dt;
+         if (dt.isValid() || m_pcold != NULL) {
+            cold()->added = dt;
+         }
       }
       // ...the addTime property
       //////////////////////////
@@ -413,23 +873,68 @@ namespace syncit {
       };
 
       Image *getImages(ImageType t) const {
-         return m_images[t];
+         return m_pcold != NULL ? m_pcold->apImages[t] : &Image::Blank;
       }
 
       void setImages(ImageType t, Image *p) {
-         Image::Detach(m_images[t]);
-         m_images[t] = p->attach();
+         if (p != getImages(t)) {
+            Cold *pc = cold();
+            Image *pOld = pc->apImages[t];
+
+            pc->apImages[t] = AttachImage(p);
+            DetachImage(pOld);
+         }
       }
 
       // ...the images property
       /////////////////////////
 
+      // The memory of this item alone, not of any elements, split
+      // between cRefs references to it.  BookmarkModel::memoryStats()
+      // calls the override for the item's kind.
+      //
+      void memoryStats(BookmarkMemoryStats &stats, unsigned long cRefs) const;
+
    protected:
-      tchar_t *m_pszName;
-      tchar_t *m_pszId;
-      tchar_t *m_pszDescription;
-      DateTime m_addTime;
-      Image *m_images[NUM_IMAGE_TYPES];
+      /**
+       * The properties that diff, sort and the menus never look at are
+       * kept in a side record, created the first time one of them is
+       * set to something other than its default.  Image::Blank, the
+       * default image, is never refcounted here.
+       */
+      struct Cold {
+         Cold();
+         ~Cold();
+
+         tchar_t *pszId;
+         tchar_t *pszDescription;
+         DateTime added;
+         DateTime modified;      // Bookmarks only
+         DateTime visited;       // Bookmarks only
+         Image   *apImages[NUM_IMAGE_TYPES];
+      };
+
+      // the side record, created if necessary
+      //
+      Cold *cold();
+
+      static Image *AttachImage(Image *p) {
+         return p == &Image::Blank ? p : p->attach();
+      }
+
+      static void DetachImage(Image *p) {
+         if (p != &Image::Blank) {
+            Image::Detach(p);
+         }
+      }
+
+      BookmarkName m_name;
+      Cold        *m_pcold;    // NULL while all cold properties are defaults
+
+      static const DateTime gdtNone;
+
+   private:
+      void destroyCold();
    };
 
    /**
@@ -462,24 +967,24 @@ namespace syncit {
       friend class BookmarkFolder;
 
    public:
-      Bookmark();
+      Bookmark(BookmarkArena *pa = NULL);
       Bookmark(const Bookmark &rhs);
 
       Bookmark &operator=(const Bookmark &rhs);
 
       ~Bookmark();
 
-      virtual bool isBookmark() const;
-
       virtual bool equals(const BookmarkObject *p) const;
 
+      void memoryStats(BookmarkMemoryStats &stats, unsigned long cRefs) const;
+
    ////////////////
    // Properties...
    //
-      Image *getDefaultImage() const { return m_images[DEFAULT_IMAGE]; }
+      Image *getDefaultImage() const { return getImages(DEFAULT_IMAGE); }
       void setDefaultImage(Image *p) { setImages(DEFAULT_IMAGE, p); }
 
-      Image *getSelectedImage() const { return m_images[SELECTED_IMAGE]; }
+      Image *getSelectedImage() const { return getImages(SELECTED_IMAGE); }
       void setSelectedImage(Image *p) { setImages(SELECTED_IMAGE, p);  }
 
 
@@ -528,7 +1033,7 @@ namespace syncit {
        * @see #setModified
        */
       const DateTime &getModified() const {
-         return m_modified;
+         return m_pcold != NULL ? m_pcold->modified : gdtNone;
       }
 
       /**
@@ -540,7 +1045,9 @@ namespace syncit {
        * @see #getModified()
        */
       void setModified(const DateTime &dt) {
-         m_modified = dt;
+         if (dt.isValid() || m_pcold != NULL) {
+            cold()->modified = dt;
+         }
       }
       //
       // ...the modified property
@@ -556,7 +1063,7 @@ namespace syncit {
        * @see #setVisited
        */
       const DateTime &getVisited() const {
-         return m_visited;
+         return m_pcold != NULL ? m_pcold->visited : gdtNone;
       }
 
       /**
@@ -566,7 +1073,9 @@ namespace syncit {
        * @see #getVisited()
        */
       void setVisited(const DateTime &dt) {
-         m_visited = dt;
+         if (dt.isValid() || m_pcold != NULL) {
+            cold()->visited = dt;
+         }
       }
       //
       // ...the visited property
@@ -578,8 +1087,6 @@ namespace syncit {
    private:
       Href     m_href;
 
-      DateTime m_modified, m_visited;
-
 #ifndef NDEBUG
       char m_achEndTag[sizeof("Bookmark")];
 #endif /* NDEBUG */
@@ -635,14 +1142,17 @@ namespace syncit {
       friend int CompareBookmarkFolders(const void *pv1, const void *pv2);
 
    public:
-      BookmarkFolder();
-      BookmarkFolder(const BookmarkFolder &rhs);
+      BookmarkFolder(BookmarkArena *pa = NULL);
+
+      // Elements, subfolders included, are shared with rhs.  Only the
+      // folder itself is new, in pa.
+      //
+      BookmarkFolder(const BookmarkFolder &rhs, BookmarkArena *pa = NULL);
 
       virtual ~BookmarkFolder();
 
       BookmarkFolder &operator=(const BookmarkFolder &rhs);
 
-      virtual bool isFolder() const;
       virtual bool isSubscription() const;
 
       bool sameElements(const BookmarkFolder *p) const {
@@ -670,13 +1180,15 @@ namespace syncit {
 
       virtual bool equals(const BookmarkObject *p) const;
 
+      void memoryStats(BookmarkMemoryStats &stats, unsigned long cRefs) const;
+
    ////////////////
    // Properties...
    //
-      Image *getOpenImage() const { return m_images[OPEN_IMAGE]; }
+      Image *getOpenImage() const { return getImages(OPEN_IMAGE); }
       void setOpenImage(Image *p) { setImages(OPEN_IMAGE, p); }
 
-      Image *getClosedImage() const { return m_images[CLOSED_IMAGE]; }
+      Image *getClosedImage() const { return getImages(CLOSED_IMAGE); }
       void setClosedImage(Image *p) { setImages(CLOSED_IMAGE, p); }
 
       //////////////
@@ -696,10 +1208,44 @@ namespace syncit {
 
       void add(BookmarkObject *p) {
          m_elements.push_back(p);
+         m_lSummary = 0;
+
+         if (m_pindex != NULL) {
+            indexAdd(p);
+         }
       }
       // ...elements
       //////////////
 
+      /**
+       * A hash of what diff() compares in the folder: the folded names
+       * of its bookmarks and subfolders, with the bookmarks' Hrefs and
+       * the subfolders' own content hashes.  It doesn't depend on the
+       * order of the elements, and leaves out what diff() skips:
+       * separators, aliases and names starting with '.'.
+       * <p>
+       * It is computed when first asked for, and kept until the folder
+       * changes.  Changes further down must be made through
+       * BookmarkModel::editFolder(), which forgets the hashes of the
+       * folders on the path.
+       */
+      unsigned __int64 getContentHash() const {
+         if (m_lSummary == 0) {
+            summarize();
+         }
+         return m_hashContent;
+      }
+
+      // Bookmarks in the folder and all its subfolders, kept along with
+      // the content hash.
+      //
+      unsigned long getBookmarkCount() const {
+         if (m_lSummary == 0) {
+            summarize();
+         }
+         return m_cBookmarks;
+      }
+
       /////////////////////////
       // The folded property...
       //
@@ -720,25 +1266,89 @@ namespace syncit {
       Bookmark *findBookmark(LPCTSTR pszName) const;
       BookmarkFolder *findBookmarkFolder(LPCTSTR pszName) const;
 
-      /**
-       * Removes a bookmark from the folder.
-       */
-      Bookmark *removeBookmark(BookmarkPath::const_iterator i, BookmarkPath::const_iterator e, const Bookmark *pb);
+      bool hasHoles() const {
+         return m_cHoles != 0;
+      }
 
-      BookmarkFolder *removeFolder(BookmarkPath::const_iterator i, BookmarkPath::const_iterator e, const BookmarkFolder *pf);
+      size_t getHoleCount() const {
+         return m_cHoles;
+      }
+
+      // close up the holes left by BookmarkModel::removeBookmark() and
+      // BookmarkModel::removeFolder()
+      //
+      void compact();
 
       void clear() {
          detachall();
          m_elements.clear();
+         m_lSummary = 0;
+         m_cHoles = 0;
+         destroyIndex();
          m_fFolded = true;
       }
 
    private:
+      friend class BookmarkModel;
+
       void detachall();
       void copy(const BookmarkFolder &rhs);
 
+      /**
+       * Big folders get a hash index of their bookmarks and subfolders
+       * by folded name, so finding a child by name doesn't scan every
+       * element.  It is built by the first search, and then kept up to
+       * date by add() and erase().
+       */
+      class Index;
+
+      enum {
+         INDEX_MIN = 16          // folders smaller than this are scanned
+      };
+
+      // Successive children named like name, ignoring case, in element
+      // order.  Start with i = 0; returns NULL when there are no more.
+      // If pk is given, it is set to the position of the child in the
+      // elements.
+      //
+      BookmarkItem *nextNamed(const BookmarkName &name, size_t &i, size_t *pk = NULL) const;
+      BookmarkItem *nextNamed(const tchar_t *psz, size_t &i, size_t *pk = NULL) const;
+      BookmarkItem *nextHashed(unsigned __int64 hash, size_t &i, size_t *pk) const;
+
+      const Index *index() const;
+      void indexAdd(BookmarkObject *p);
+      void destroyIndex();
+
+      // The child matching pItem, as a removal from the folder wants it:
+      // a bookmark of the same name and href, or an empty folder of the
+      // same name.  If pk is given, it is set to its position.
+      //
+      BookmarkItem *findRemovable(const BookmarkItem *pItem, size_t *pk) const;
+
+      // leave a hole in place of the k'th element, without detaching it
+      //
+      void erase(size_t k);
+
+      // compute the content hash and bookmark count of this folder and
+      // of any subfolders that don't have them yet
+      //
+      void summarize() const;
+
+      // replace the element pOld by pNew, without detaching pOld
+      //
+      void replace(BookmarkObject *pOld, BookmarkObject *pNew);
+
       bool m_fFolded;
       BookmarkVector m_elements;
+      size_t m_cHoles;                    // NULL elements, see compact()
+      mutable Index *volatile m_pindex;   // NULL until index() builds it
+
+      // Shared folders may be summarized by several threads at once:
+      // they all store the same values, and then set m_lSummary.
+      //
+      mutable unsigned __int64 m_hashContent;
+      mutable unsigned long m_cBookmarks;
+      mutable volatile LONG m_lSummary;   // 0 until summarize()
 
 #ifndef NDEBUG
    private:
@@ -750,11 +1360,11 @@ namespace syncit {
    class BookmarkSubscription : public BookmarkFolder {
 
    public:
-      BookmarkSubscription() : BookmarkFolder() {
+      BookmarkSubscription(BookmarkArena *pa = NULL) : BookmarkFolder(pa) {
          m_seqno = 0;
       }
 
-      BookmarkSubscription(const BookmarkSubscription &rhs) : BookmarkFolder(rhs) {
+      BookmarkSubscription(const BookmarkSubscription &rhs, BookmarkArena *pa = NULL) : BookmarkFolder(rhs, pa) {
          m_seqno = rhs.m_seqno;
       }
 
@@ -787,6 +1397,119 @@ namespace syncit {
       long m_seqno;
    };
 
+   /**
+    * BookmarkWalker walks a folder tree depth first, keeping its own
+    * stack on the heap instead of recursing, so a tree of any depth
+    * can be visited.  next() returns ENTER for each folder (the root
+    * included) before its elements, LEAVE after them, and ITEM for
+    * every other element; END when the walk is done:
+    *
+    * <pre>
+    *    BookmarkWalker walker(pbf);
+    *    BookmarkWalker::Event e;
+    *
+    *    while ((e = walker.next()) != BookmarkWalker::END) {
+    *       ... walker.get(), walker.depth() ...
+    *    }
+    * </pre>
+    *
+    * The tree must not change during the walk.
+    */
+   class BookmarkWalker {
+   public:
+      enum Event { END, ENTER, ITEM, LEAVE };
+
+      BookmarkWalker(const BookmarkFolder *pbfRoot) {
+         m_pbfRoot = pbfRoot;
+         m_p = NULL;
+         m_depth = 0;
+      }
+
+      Event next();
+
+      // The folder entered or left, or the item; NULL at END.
+      //
+      const BookmarkObject *get() const {
+         return m_p;
+      }
+
+      // 0 for the root, 1 for its elements, and so on.
+      //
+      int depth() const {
+         return m_depth;
+      }
+
+      // Right after ENTER: go on to the folder's LEAVE, without its
+      // elements.
+      //
+      void skip() {
+         m_stack.back().i = m_stack.back().pbf->end();
+      }
+
+   private:
+      struct Frame {
+         const BookmarkFolder *pbf;
+         BookmarkVector::const_iterator i;
+      };
+
+      vector<Frame> m_stack;
+      const BookmarkFolder *m_pbfRoot;   // until the first next()
+      const BookmarkObject *m_p;
+      int m_depth;
+   };
+
+   /**
+    * BookmarkAliases maps the ALIASIDs of a model's bookmarks and folders
+    * to the items themselves, for BookmarkAlias objects to refer to.  It is an
+    * open-addressing hash table (linear probing) on the interned ids, so
+    * copying a model copies the table as it stands, and edits keep it up
+    * to date one id at a time.
+    */
+   class BookmarkAliases {
+   public:
+      BookmarkAliases() {
+         m_pslots = NULL;
+         m_cSlots = 0;
+         m_cUsed = 0;
+      }
+
+      BookmarkAliases(const BookmarkAliases &rhs);
+
+      ~BookmarkAliases() {
+         clear();
+      }
+
+      BookmarkAliases &operator=(const BookmarkAliases &rhs);
+
+      BookmarkItem *find(const tchar_t *psz) const;
+      void define(const tchar_t *psz, BookmarkItem *p);
+      void remove(const tchar_t *psz);
+      void clear();
+
+      void memoryStats(BookmarkMemoryStats &stats) const;
+
+   private:
+      struct Slot {
+         Slot() {
+            p = NULL;
+         }
+
+         BookmarkName id;
+         BookmarkItem *p;        // NULL for an empty slot
+      };
+
+      struct SlotTraits;         // see ProbeTable.h
+
+      // the slot holding psz, else the empty slot ending its probe
+      //
+      size_t lookup(const tchar_t *psz) const;
+      void grow();
+
+      Slot  *m_pslots;
+      size_t m_cSlots;           // zero or a power of two
+      size_t m_cUsed;
+   };
+
    class BookmarkModel : public BookmarkSubscription {
 
       friend class BookmarkContext;
@@ -794,6 +1517,7 @@ namespace syncit {
    public:
       BookmarkModel();
       BookmarkModel(const BookmarkModel &rhs);
+      ~BookmarkModel();
 
       BookmarkModel &operator=(const BookmarkModel &rhs);
 
@@ -806,26 +1530,33 @@ namespace syncit {
       }
 
       const BookmarkItem *findId(const tchar_t *s) const {
-         map<tstring, BookmarkItem *>::const_iterator i = m_aliases.find(s);
-
-         if (i == m_aliases.end())
-            return NULL;
-         else
-            return (*i).second;
+         return m_aliases.find(s);
       }
 
       void removeAliasId(const tchar_t *s) {
-         map<tstring, BookmarkItem *>::iterator i = m_aliases.find(s);
-
-         if (i != m_aliases.end()) {
-            m_aliases.erase(i);
-         }
+         m_aliases.remove(s);
       }
 
       void defineAliasId(const tchar_t *s, BookmarkItem *p) {
-         m_aliases[s] = p;
+         m_aliases.define(s, p);
       }
 
+      // Define the ids of p and, for a folder, of everything in it: for
+      // items added to the model from elsewhere.
+      //
+      void defineAliasIds(BookmarkItem *p);
+
+      // p, for adding to this model: shared if it is on the heap or in
+      // this model's arena, else copied onto the heap along with
+      // whatever below it is in another arena.
+      //
+      BookmarkObject *adopt(const BookmarkObject *p);
+
+      // the same for the elements of pf, in a new plain folder: for
+      // subscriptions, which are only added as folders
+      //
+      BookmarkFolder *adoptAsFolder(const BookmarkFolder *pf);
+
       void clear() {
          BookmarkSubscription::clear();
          m_aliases.clear();
@@ -833,10 +1564,58 @@ namespace syncit {
          m_pMenuHeader = NULL;
       }
 
+      /**
+       * Adds the memory of every node in the model, and of its alias
+       * table, to stats.  Nodes below a shared folder count as shared
+       * too.  The intern tables are global: see Href::MemoryStats()
+       * and BookmarkName::MemoryStats().
+       */
+      void memoryStats(BookmarkMemoryStats &stats) const;
+
+      /**
+       * Models share folders: copying a model only shares its top
+       * level elements, and the folders below them stay shared until
+       * one of the models changes them.  So changes go through path
+       * copying: editFolder() finds the folder named by the path, as
+       * BookmarkMerger walks it, after replacing it and each of its
+       * ancestors with a private copy if they are shared.  Folders of
+       * the same name are tried in turn, and nothing is copied unless
+       * the whole path is found.
+       *
+       * @return the folder, which may now be changed, or NULL
+       */
+      BookmarkFolder *editFolder(BookmarkPath::const_iterator i, BookmarkPath::const_iterator e);
+
+      /**
+       * Removes a bookmark from the folder named by the path.  Like
+       * editFolder() it tries each folder of the same name in turn, and
+       * only the folders down to the one actually holding pb are
+       * unshared.  Removing leaves a NULL hole in that folder's
+       * elements, so a run of removals costs one compact() rather than
+       * a vector shift each.  Until then begin() to end() includes the
+       * holes; BookmarkWalker and ExtractFromFolder() pass over them.
+       *
+       * @return the bookmark, no longer in the model but not detached,
+       *    or NULL.  *ppbfParent is set to the folder it was removed from.
+       */
+      Bookmark *removeBookmark(BookmarkPath::const_iterator i, BookmarkPath::const_iterator e, const Bookmark *pb, BookmarkFolder **ppbfParent) {
+         return (Bookmark *) removeItem(i, e, pb, ppbfParent);
+      }
+
+      // the same for an empty folder
+      //
+      BookmarkFolder *removeFolder(BookmarkPath::const_iterator i, BookmarkPath::const_iterator e, const BookmarkFolder *pf, BookmarkFolder **ppbfParent) {
+         return (BookmarkFolder *) removeItem(i, e, pf, ppbfParent);
+      }
+
    private:
-      void rebuild(BookmarkFolder *pbf);
+      BookmarkItem *removeItem(BookmarkPath::const_iterator i, BookmarkPath::const_iterator e, const BookmarkItem *pItem, BookmarkFolder **ppbfParent);
+      void adoptElements(BookmarkFolder *pbf);
+      static bool findPath(const BookmarkFolder *pbf, BookmarkPath::const_iterator i, BookmarkPath::const_iterator e, const BookmarkItem *pItem, BookmarkPath &found);
+      BookmarkFolder *unsharePath(const BookmarkPath &found);
+      BookmarkFolder *unshare(BookmarkFolder *pbfParent, BookmarkFolder *pOld);
 
-      map<tstring, BookmarkItem *> m_aliases;
+      BookmarkAliases m_aliases;
 
       BookmarkFolder *m_pNewItemHeader;
       BookmarkFolder *m_pMenuHeader;
@@ -870,6 +1649,17 @@ namespace syncit {
       virtual void delBookmark(const Bookmark *pOld) = 0;
 
       virtual void pushFolder(const BookmarkFolder *pbf) = 0;
+
+      // diff() pushes a folder through this, with the first of the old
+      // folders of the same name that it is matched with.  By default it
+      // is just pushFolder(pbf).
+      //
+      virtual void pushFolderPair(const BookmarkFolder *pbf, const BookmarkFolder *pbfOld);
+
+      // The default addFolder() and delFolder() walk the folder with a
+      // BookmarkWalker, reporting it and every folder inside it through
+      // add0() or del0() between pushFolder() and popFolder().
+      //
       virtual void addFolder(const BookmarkFolder *pNew);
       virtual void add0(const BookmarkFolder *pNew);
 
@@ -877,6 +1667,25 @@ namespace syncit {
       virtual void del0(const BookmarkFolder *pOld);
       virtual void popFolder() = 0;
 
+      // With DIFF_DETECT_MOVES, diff() pairs an item it would delete in
+      // one folder with an equal one it would add in another, or under
+      // another name, and reports them as one call where the add would
+      // be: renameItem() if both are in the same folder, moveBookmark()
+      // or moveFolder() if not, with pathOld the old tree's folders
+      // leading to pOld.  Only a
+      // listener whose acceptsMoves() is true gets these calls; others
+      // get the deletes and adds.
+      //
+      virtual bool acceptsMoves() const;
+      virtual void moveBookmark(const Bookmark *pNew, const Bookmark *pOld, const BookmarkPath &pathOld);
+      virtual void moveFolder(const BookmarkFolder *pNew, const BookmarkFolder *pOld, const BookmarkPath &pathOld);
+      virtual void renameItem(const BookmarkItem *pNew, const BookmarkItem *pOld);
+
+      // Called by diff() once all the differences are reported, to
+      // apply any edits held back until then.
+      //
+      virtual void commit();
+
    private:
       // disable copy constructor and assignment
       //
@@ -1072,7 +1881,7 @@ namespace syncit {
          return 0;
       }
       else {
-         int c = tstricmp(p1->getName(), p2->getName());
+         int c = p1->getNameAtom().compareIgnoreCase(p2->getNameAtom());
 
       //   if (c == 0) {
       //      c = p1->getId().compare(p2->getId());
@@ -1090,15 +1899,17 @@ namespace syncit {
 
    inline
    int BookmarkCompare(const Bookmark *p1,
-                       const Bookmark *p2) {
+                       const Bookmark *p2,
+                       bool fEquivalent = false) {
       if (p1 == p2) {
          return 0;
       }
       else {
-         int c = tstricmp(p1->getName(), p2->getName());
+         int c = p1->getNameAtom().compareIgnoreCase(p2->getNameAtom());
 
          if (c == 0) {
-            c = Href::Compare(p1->getHref(), p2->getHref());
+            c = fEquivalent ? Href::CompareEquivalent(p1->getHref(), p2->getHref())
+                            : Href::Compare(p1->getHref(), p2->getHref());
          }
 
          return c;
@@ -1111,13 +1922,98 @@ namespace syncit {
       return BookmarkCompare(p1, p2) < 0;
    }
 
+   inline
+   bool BookmarkEquivalentLess(const Bookmark *p1,
+                               const Bookmark *p2) {
+      return BookmarkCompare(p1, p2, true) < 0;
+   }
+
+   /**
+    * Sort as sort() with BookmarkLess (or BookmarkEquivalentLess) and
+    * BookmarkFolderLess would, but on the names' sort keys copied next
+    * to the pointers: only ties go to the atoms and the full comparison.
+    */
+   void SortBookmarks(vector<const Bookmark *> &vb, bool fEquivalent = false);
+   void SortBookmarkFolders(vector<const BookmarkFolder *> &vf);
+
    void ExtractFromFolder(const BookmarkFolder *pbf,
                           vector<const Bookmark *> &vb,
                           vector<const BookmarkFolder *> &vf);
 
+   enum {
+      DIFF_EQUIVALENT_HREFS = 0x0001,  // match bookmarks by Href::CompareEquivalent
+      DIFF_HASH_JOIN        = 0x0002,  // match children by hash instead of sorting
+      DIFF_PARALLEL         = 0x0004,  // diff matched subtrees on worker threads
+      DIFF_DETECT_MOVES     = 0x0008   // report moved and renamed items as such
+   };
+
    int diff(const BookmarkFolder *pf1,
             const BookmarkFolder *pf2,
-            BookmarkDifferences *pdiff);
+            BookmarkDifferences *pdiff,
+            unsigned flags = 0);
+   //
+   // With DIFF_PARALLEL, pdiff still gets its calls on the calling
+   // thread and in the same order, once every subtree is diffed; it
+   // is ignored with DIFF_HASH_JOIN.
+
+   /**
+    * diff() with DIFF_HASH_JOIN: children are matched through a hash
+    * table on the folded name (and href) in linear time, with scratch
+    * space reused across the whole tree.  It reports the same
+    * differences, but in the folders' own order rather than sorted.
+    */
+   int HashJoinDiff(const BookmarkFolder *pf1,
+                    const BookmarkFolder *pf2,
+                    BookmarkDifferences *pdiff,
+                    unsigned flags);
+
+   /**
+    * Told by merge3() of an item changed on both sides.
+    */
+   class BookmarkConflicts {
+   protected:
+      BookmarkConflicts() {
+      }
+
+   public:
+      virtual ~BookmarkConflicts() {
+      }
+
+      /**
+       * pBase was changed to pLocal on one side and to pRemote on the
+       * other, either of them NULL if it was deleted there.  Both
+       * changes are kept: a deleted folder that was changed on the
+       * other side stays, and of two bookmarks given different hrefs
+       * under the same name, both go in.
+       */
+      virtual void conflict(const BookmarkItem *pBase,
+                            const BookmarkItem *pLocal,
+                            const BookmarkItem *pRemote) = 0;
+
+   private:
+      // disable copy constructor and assignment
+      //
+      BookmarkConflicts(BookmarkConflicts &rhs);
+      BookmarkConflicts &operator=(BookmarkConflicts &rhs);
+   };
+
+   /**
+    * Three-way merge: walk pBase, pLocal and pRemote together, once,
+    * and report to pdiff the edits that bring the remote changes since
+    * pBase into pLocal, as diff() reports the edits from one tree to
+    * another.  Items are matched as diff() matches them (flags takes
+    * DIFF_EQUIVALENT_HREFS), and subtrees that are unchanged on one
+    * side are passed over by their content hashes.  Items added on
+    * both sides go in once.
+    *
+    * @return the number of edits reported
+    */
+   int merge3(const BookmarkFolder *pBase,
+              const BookmarkFolder *pLocal,
+              const BookmarkFolder *pRemote,
+              BookmarkDifferences *pdiff,
+              BookmarkConflicts *pconflicts = NULL,
+              unsigned flags = 0);
 
 }
 
@@ -0,0 +1,219 @@
+/*
+ * BookmarkLib/BookmarkName.cxx
+ * Copyright (C) 2003  SyncIT.com, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * -----------------
+ * This program is GPL'd.  If you distribute this program or a derivative of
+ * this program publicly you must include the source code.  It is easy
+ * enough to drop me an email requesting a different license, if necessary.
+ *
+ * Description: BookmarkSync client software for Windows
+ * Created:     October 2026
+ * Web site:    http://www.syncit.com
+ */
+#pragma warning (disable : 4786)
+
+#include <cstring>
+
+#include "BookmarkModel.h"
+
+#include "SyncLib/Character.h"
+
+using namespace syncit;
+
+Href::Table BookmarkName::m_gtables[Href::SHARDS];
+
+// Pack the leading folded characters, most significant first, padding
+// past the end with the terminating 0.  tstricmp compares chars as
+// signed ints, so flip their top bit to make unsigned key order agree.
+//
+static unsigned __int64 SortKey(const tchar_t *pszFolded) {
+   unsigned __int64 key = 0;
+   const size_t n = sizeof(key) / sizeof(tchar_t);
+   bool fEnd = false;
+
+   for (size_t i = 0; i < n; i++) {
+      tchar_t ch = fEnd ? 0 : pszFolded[i];
+
+      fEnd = ch == 0;
+
+#ifdef TEXT16
+      key = (key << 16) | (unsigned short) ch;
+#else
+      key = (key << 8) | (unsigned char) (ch ^ 0x80);
+#endif /* TEXT16 */
+   }
+
+   return key;
+}
+
+void BookmarkName::assign(const tchar_t *psz) {
+   if (psz == c_str()) {
+      return;
+   }
+
+   if (psz == NULL) {
+      release();
+      return;
+   }
+
+   // construct the atom for lookup on the stack when the name fits,
+   // which is almost always
+   //
+   union {
+      char ab[1024];
+      Atom a;
+   } u;
+
+   size_t cch = tstrlen(psz);
+   size_t cb = sizeof(Atom) + cch * 2 * sizeof(tchar_t);
+   Atom *pa = cb <= sizeof(u) ? &u.a : (Atom *) NEW char[cb];
+   tchar_t *pszFolded = pa->ach + cch + 1;
+
+   for (size_t i = 0; i <= cch; i++) {
+      pa->ach[i] = psz[i];
+      pszFolded[i] = Character::toUpper(psz[i]);
+   }
+
+   pa->refcount = 0;
+   pa->cch = cch;
+   pa->hash = Href::Hash(0xCBF29CE484222325ui64, pszFolded, cch * sizeof(tchar_t));
+   pa->key = SortKey(pszFolded);
+
+   Href::Table &table = Href::GetTable(m_gtables, pa);
+
+   table.enter();
+
+   Atom *p = (Atom *) table.find(pa, CompareEntry);
+
+   if (p == NULL) {
+      if (pa == &u.a) {
+         p = (Atom *) NEW char[cb];
+         memcpy(p, pa, cb);
+      }
+      else {
+         p = pa;
+         pa = NULL;
+      }
+
+      table.insert(p);
+   }
+
+   // take the reference while still locked, see Href::Release0()
+   //
+   InterlockedIncrement(&p->refcount);
+
+   table.leave();
+
+   if (pa != &u.a) {
+      delete[] (char *) pa;
+   }
+
+   release();
+   m_p = p;
+}
+
+void BookmarkName::memoryStats(BookmarkMemoryStats &stats, unsigned long cRefs) const {
+   if (m_p != NULL) {
+      stats.add(BookmarkMemoryStats::STRINGS, sizeof(Atom) + 2 * m_p->cch * sizeof(tchar_t),
+                BookmarkMemoryStats::Product(cRefs, m_p->refcount));
+   }
+}
+
+/* static */
+void BookmarkName::MemoryStats(BookmarkMemoryStats &stats) {
+   for (int i = 0; i < Href::SHARDS; i++) {
+      m_gtables[i].enter();
+      stats.add(BookmarkMemoryStats::VECTORS, m_gtables[i].getMemorySize());
+      m_gtables[i].leave();
+   }
+}
+
+void BookmarkName::release() {
+   if (m_p != NULL) {
+      if (Href::Release0(m_p, Href::GetTable(m_gtables, m_p))) {
+         delete[] (char *) m_p;
+      }
+
+      m_p = NULL;
+   }
+}
+
+/* static */
+unsigned __int64 BookmarkName::FoldedHash(const tchar_t *psz) {
+   if (psz == NULL) {
+      return 0;
+   }
+
+   unsigned __int64 h = 0xCBF29CE484222325ui64;
+
+   while (*psz != 0) {
+      tchar_t ch = Character::toUpper(*psz++);
+
+      h = Href::Hash(h, &ch, sizeof(ch));
+   }
+
+   return h;
+}
+
+bool BookmarkName::equalsIgnoreCase(const BookmarkName &rhs) const {
+   if (m_p == rhs.m_p) {
+      return true;
+   }
+   else if (m_p == NULL || rhs.m_p == NULL) {
+      return false;
+   }
+   else {
+      return m_p->hash == rhs.m_p->hash &&
+             m_p->cch == rhs.m_p->cch &&
+             memcmp(folded(), rhs.folded(), m_p->cch * sizeof(tchar_t)) == 0;
+   }
+}
+
+int BookmarkName::compareIgnoreCase(const BookmarkName &rhs) const {
+   if (m_p == rhs.m_p) {
+      return 0;
+   }
+   else if (m_p->key != rhs.m_p->key) {
+      return m_p->key < rhs.m_p->key ? -1 : 1;
+   }
+
+   // the same loop as tstricmp, on characters already folded
+   //
+   const tchar_t *psz1 = folded(), *psz2 = rhs.folded();
+   tchar_t ch1 = *psz1++;
+   tchar_t ch2 = *psz2++;
+
+   while (ch1 && ch1 == ch2) {
+      ch1 = *psz1++;
+      ch2 = *psz2++;
+   }
+
+   return (int) ch1 - (int) ch2;
+}
+
+/* static */
+int BookmarkName::CompareEntry(const Href::Entry *pe1, const Href::Entry *pe2) {
+   const Atom *pa1 = (const Atom *) pe1;
+   const Atom *pa2 = (const Atom *) pe2;
+
+   if (pa1->cch != pa2->cch) {
+      return (int) pa1->cch - (int) pa2->cch;
+   }
+   else {
+      return memcmp(pa1->ach, pa2->ach, pa1->cch * sizeof(tchar_t));
+   }
+}
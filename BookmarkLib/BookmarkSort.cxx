@@ -0,0 +1,117 @@
+/*
+ * BookmarkLib/BookmarkSort.cxx
+ * Copyright (C) 2003  SyncIT.com, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * -----------------
+ * This program is GPL'd.  If you distribute this program or a derivative of
+ * this program publicly you must include the source code.  It is easy
+ * enough to drop me an email requesting a different license, if necessary.
+ *
+ * Description: BookmarkSync client software for Windows
+ * Created:     October 2026
+ * Web site:    http://www.syncit.com
+ */
+#pragma warning (disable : 4786)
+
+#include <algorithm>
+
+#include "BookmarkModel.h"
+
+using namespace syncit;
+
+// A pointer with its name's sort key alongside, so most comparisons
+// are a single integer compare on memory that sort() is already
+// moving, instead of two trips to the name atoms.
+//
+struct KeyedBookmark {
+   unsigned __int64 key;
+   const Bookmark *p;
+};
+
+struct KeyedFolder {
+   unsigned __int64 key;
+   const BookmarkFolder *p;
+};
+
+class KeyedBookmarkLess {
+public:
+   KeyedBookmarkLess(bool fEquivalent) {
+      m_fEquivalent = fEquivalent;
+   }
+
+   bool operator()(const KeyedBookmark &k1, const KeyedBookmark &k2) const {
+      if (k1.key != k2.key) {
+         return k1.key < k2.key;
+      }
+      else {
+         return BookmarkCompare(k1.p, k2.p, m_fEquivalent) < 0;
+      }
+   }
+
+private:
+   bool m_fEquivalent;
+};
+
+static bool KeyedFolderLess(const KeyedFolder &k1, const KeyedFolder &k2) {
+   if (k1.key != k2.key) {
+      return k1.key < k2.key;
+   }
+   else {
+      return BookmarkFolderCompare(k1.p, k2.p) < 0;
+   }
+}
+
+void syncit::SortBookmarks(vector<const Bookmark *> &vb, bool fEquivalent) {
+   size_t i, n = vb.size();
+
+   if (n < 2) {
+      return;
+   }
+
+   vector<KeyedBookmark> v(n);
+
+   for (i = 0; i < n; i++) {
+      v[i].key = vb[i]->getNameAtom().getSortKey();
+      v[i].p = vb[i];
+   }
+
+   sort(v.begin(), v.end(), KeyedBookmarkLess(fEquivalent));
+
+   for (i = 0; i < n; i++) {
+      vb[i] = v[i].p;
+   }
+}
+
+void syncit::SortBookmarkFolders(vector<const BookmarkFolder *> &vf) {
+   size_t i, n = vf.size();
+
+   if (n < 2) {
+      return;
+   }
+
+   vector<KeyedFolder> v(n);
+
+   for (i = 0; i < n; i++) {
+      v[i].key = vf[i]->getNameAtom().getSortKey();
+      v[i].p = vf[i];
+   }
+
+   sort(v.begin(), v.end(), KeyedFolderLess);
+
+   for (i = 0; i < n; i++) {
+      vf[i] = v[i].p;
+   }
+}
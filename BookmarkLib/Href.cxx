@@ -30,75 +30,345 @@
 #pragma warning (disable : 4786)
 
 #include <cassert>
+#include <cctype>
+#include <cstring>
 
 #include "BookmarkModel.h"
+#include "ProbeTable.h"
+
+#include "SyncLib/PrintWriter.h"
 
 using namespace syncit;
 
-Href::Table Href::m_gtable;
+static bool strequal(const char *psz1, const char *psz2, size_t n);
+static bool canonicalize(const char *psz, char *pach, size_t cch);
+
+Href::Table Href::m_gtables[Href::SHARDS];
+Href::Table Href::m_ghosts[Href::SHARDS];
+
+Href::Table::Table() {
+   m_ppe = NULL;
+   m_cSlots = 0;
+   m_cUsed = 0;
+}
 
-#ifndef NDEBUG
 Href::Table::~Table() {
-   Set::iterator i = m_set.begin(), e = m_set.end();
+#ifndef NDEBUG
+   for (size_t i = 0; i < m_cSlots; i++) {
+      if (m_ppe[i] != NULL) {
+         delete[] (char *) m_ppe[i];
+      }
+   }
+#endif /* NDEBUG */
+
+   u_free0(m_ppe);
+}
+
+struct Href::Table::SlotTraits {
+   bool empty(Entry *const &pe) const {
+      return pe == NULL;
+   }
 
-   while (i != e) {
-      delete *i++;
+   unsigned __int64 hash(Entry *const &pe) const {
+      return pe->hash;
+   }
+
+   void clear(Entry *&pe) const {
+      pe = NULL;
+   }
+};
+
+Href::Entry *Href::Table::find(const Entry *pe, int (*pfnCompare)(const Entry *, const Entry *)) const {
+   if (m_cSlots == 0) {
+      return NULL;
+   }
+
+   size_t mask = m_cSlots - 1;
+   size_t i = (size_t) pe->hash & mask;
+   Entry *p;
+
+   while ((p = m_ppe[i]) != NULL) {
+      if (p->hash == pe->hash && (*pfnCompare)(p, pe) == 0) {
+         return p;
+      }
+
+      i = (i + 1) & mask;
+   }
+
+   return NULL;
+}
+
+void Href::Table::insert(Entry *pe) {
+   // keep the table at most half full, so probe sequences stay short
+   //
+   if ((m_cUsed + 1) * 2 > m_cSlots) {
+      grow();
+   }
+
+   m_ppe[ProbeEmpty(m_ppe, m_cSlots, pe->hash, SlotTraits())] = pe;
+   m_cUsed++;
+}
+
+void Href::Table::erase(const Entry *pe) {
+   size_t mask = m_cSlots - 1;
+   size_t i = (size_t) pe->hash & mask;
+
+   while (m_ppe[i] != pe) {
+      assert(m_ppe[i] != NULL);
+      i = (i + 1) & mask;
+   }
+
+   ProbeErase(m_ppe, m_cSlots, i, SlotTraits());
+   m_cUsed--;
+}
+
+void Href::Table::grow() {
+   Entry **ppeOld = m_ppe;
+   size_t cOld = m_cSlots;
+
+   m_cSlots = cOld == 0 ? 1024 : cOld * 2;
+   m_ppe = (Entry **) u_calloc(m_cSlots, sizeof(Entry *));
+   m_cUsed = 0;
+
+   for (size_t i = 0; i < cOld; i++) {
+      if (ppeOld[i] != NULL) {
+         insert(ppeOld[i]);
+      }
+   }
+
+   u_free0(ppeOld);
+}
+
+void Href::memoryStats(BookmarkMemoryStats &stats, unsigned long cRefs) const {
+   const Data *pd = m_p;
+
+   // the data, then its canonical form if that is another
+   //
+   while (pd != NULL) {
+      unsigned long cData = BookmarkMemoryStats::Product(cRefs, pd->refcount);
+
+      stats.add(BookmarkMemoryStats::HREFS, sizeof(Data) + pd->cchPath, cData);
+      stats.add(BookmarkMemoryStats::HREFS, sizeof(Host) + pd->phost->cch,
+                BookmarkMemoryStats::Product(cData, pd->phost->refcount));
+
+      cRefs = cData;
+      pd = pd->pcanon != pd ? pd->pcanon : NULL;
+   }
+}
+
+/* static */
+void Href::MemoryStats(BookmarkMemoryStats &stats) {
+   for (int i = 0; i < SHARDS; i++) {
+      m_gtables[i].enter();
+      stats.add(BookmarkMemoryStats::VECTORS, m_gtables[i].getMemorySize());
+      m_gtables[i].leave();
+
+      m_ghosts[i].enter();
+      stats.add(BookmarkMemoryStats::VECTORS, m_ghosts[i].getMemorySize());
+      m_ghosts[i].leave();
    }
 }
-#endif /* NDEBUG */
 
 Href::Data *Href::Attach(Href::Data *p) {
-   p->flags++;
+   if (p != NULL) {
+      InterlockedIncrement(&p->refcount);
+   }
+
    return p;
 }
 
 void Href::release() {
    if (m_p != NULL) {
       assert(refcount() != 0);
-      m_p->flags--;
 
-      if (refcount() == 0) {
-         if (m_p->flags & INTERNED_MASK) {
-            Set::iterator i = m_gtable.m_set.find(m_p);
+      Release(m_p);
+   }
+}
+
+void Href::Release(Data *pd) {
+   bool fLast;
+
+   if (pd->flags & INTERNED_MASK) {
+      fLast = Release0(pd, GetTable(m_gtables, pd));
+   }
+   else {
+      fLast = InterlockedDecrement(&pd->refcount) == 0;
+   }
+
+   if (fLast) {
+      Host *ph = pd->phost;
+      Data *pcanon = pd->pcanon;
+
+      delete[] (char *) pd;
+
+      if (Release0(ph, GetTable(m_ghosts, ph))) {
+         delete[] (char *) ph;
+      }
+
+      if (pcanon != pd) {
+         Release(pcanon);
+      }
+   }
+}
 
-            assert(i != m_gtable.m_set.end());
-            m_gtable.m_set.erase(i);
-         }
+bool Href::Release0(Entry *pe, Table &table) {
+   // An interned Entry may only drop to zero while its Table is
+   // locked, otherwise Intern() could hand it out again after we
+   // decided to delete it.  Most releases aren't the last one and
+   // never touch the lock.
+   //
+   for (;;) {
+      LONG l = pe->refcount;
+
+      if (l <= 1) {
+         break;
+      }
 
-         delete[] (char *) m_p;
+      if (InterlockedCompareExchange(&pe->refcount, l - 1, l) == l) {
+         return false;
       }
    }
+
+   table.enter();
+
+   bool fLast = InterlockedDecrement(&pe->refcount) == 0;
+
+   if (fLast) {
+      table.erase(pe);
+   }
+
+   table.leave();
+
+   return fLast;
+}
+
+Href::Host *Href::InternHost(const Host *ph, size_t cb) {
+   Table &table = GetTable(m_ghosts, ph);
+
+   table.enter();
+
+   Host *p = (Host *) table.find(ph, CompareHostEntry);
+
+   if (p == NULL) {
+      p = (Host *) NEW char[cb];
+      memcpy(p, ph, cb);
+
+      table.insert(p);
+   }
+
+   InterlockedIncrement(&p->refcount);
+
+   table.leave();
+
+   return p;
 }
 
 Href Href::Intern(const char *psz) {
-   // construct a temporary Href for set lookup
+   // construct a temporary Href for table lookup
    union {
       char ab[4096];
       Data d;
    } u;
 
-   size_t cb = init(&u.d, psz);
+   union {
+      char ab[4096];
+      Host h;
+   } uh;
+
+   size_t cbHost;
+   size_t cb = init(&u.d, &uh.h, cbHost, psz);
+
+   // the Data key includes the interned Host pointer, so the host
+   // string is only ever compared once, here
+   //
+   Host *ph = InternHost(&uh.h, cbHost);
 
-   Set::const_iterator i = m_gtable.m_set.find(&u.d);
+   u.d.phost = ph;
+   u.d.hash = Hash(ph->hash, &u.d.flags, sizeof(u.d.flags));
+   u.d.hash = Hash(u.d.hash, u.d.ach, u.d.cchPath);
 
-   if (i == m_gtable.m_set.end()) {
-      Data *pnew = (Data *) NEW char[cb];
-      memcpy(pnew, &u.d, cb);
+   Table &table = GetTable(m_gtables, &u.d);
 
-      pnew->flags = (pnew->flags + 1) | INTERNED_MASK;
+   table.enter();
 
-      m_gtable.m_set.insert(pnew);
+   Data *p = (Data *) table.find(&u.d, CompareEntry);
+   bool fNew = p == NULL;
 
-      return Href(pnew);
+   if (fNew) {
+      // A new URL: intern its canonical form first, without holding our
+      // lock, then look again in case another thread got here meanwhile.
+      //
+      char achCanon[4096];
+      Href canon;
+
+      if (canonicalize(psz, achCanon, ELEMENTS(achCanon))) {
+         table.leave();
+         canon = Intern(achCanon);
+         table.enter();
+
+         p = (Data *) table.find(&u.d, CompareEntry);
+         fNew = p == NULL;
+      }
+
+      if (fNew) {
+         p = (Data *) NEW char[cb];
+         memcpy(p, &u.d, cb);
+
+         p->flags |= INTERNED_MASK;
+         p->pcanon = canon.m_p != NULL ? Attach(canon.m_p) : p;
+
+         table.insert(p);
+      }
    }
-   else {
-      return Href(*i);
+
+   // take the reference while still locked, see release()
+   //
+   Href href(p);
+
+   table.leave();
+
+   // a new Data keeps the Host reference, else drop it
+   //
+   if (!fNew && Release0(ph, GetTable(m_ghosts, ph))) {
+      delete[] (char *) ph;
+   }
+
+   return href;
+}
+
+static const char *ProtocolPrefix(Href::Protocol protocol, size_t &cch) {
+   switch (protocol) {
+      case Href::AOL:      cch = 4; return "aol:";
+      case Href::FTP:      cch = 6; return "ftp://";
+      case Href::HTTP:     cch = 7; return "http://";
+      case Href::HTTPS:    cch = 8; return "https://";
+      case Href::MAILTO:   cch = 7; return "mailto:";
+      case Href::SOCKS:    cch = 6; return "socks:";
+      case Href::FILE:     cch = 5; return "file:";
+
+      case Href::OTHER_PROTOCOL:
+      default:
+         cch = 0; return "";
    }
 }
 
-size_t Href::getHost0(char *pach, size_t cch, size_t l) const {
+static const char *DomainSuffix(Href::Domain domain, size_t &cch) {
+   switch (domain) {
+      case Href::COM:      cch = 4; return ".com";
+      case Href::ORG:      cch = 4; return ".org";
+      case Href::NET:      cch = 4; return ".net";
+
+      case Href::OTHER_DOMAIN:
+      default:
+         cch = 0; return "";
+   }
+}
+
+size_t Href::getHost0(char *pach, size_t cch) const {
+   const Host *ph = m_p->phost;
+   const char *psz;
    char *p = pach;
-   size_t i;
+   size_t i, l;
 
    if (getWWW()) {
       i = bufcopy("www.", 4, p, cch);
@@ -106,68 +376,215 @@ size_t Href::getHost0(char *pach, size_t cch, size_t l) const {
       cch -= i;
    }
 
-   i = bufcopy(m_p->ach, l, p, cch);
+   i = bufcopy(ph->ach, ph->cch, p, cch);
    p += i;
    cch -= i;
 
-   switch (getDomain()) {
-      case COM:      i = bufcopy(".com", 4, p, cch); break;
-      case ORG:      i = bufcopy(".org", 4, p, cch); break;
-      case NET:      i = bufcopy(".net", 4, p, cch); break;
-
-      case OTHER_DOMAIN:
-      default:
-         i = 0;
-   }
+   psz = DomainSuffix(getDomain(), l);
+   i = bufcopy(psz, l, p, cch);
 
    return (p - pach) + i;
 }
 
 size_t Href::format(char *pach, size_t cch) const {
+   const char *psz;
    char *p = pach;
-   size_t i;
-
-   switch (getProtocol()) {
-      case AOL:      i = bufcopy("aol:", 4, p, cch); break;
-      case FTP:      i = bufcopy("ftp://", 6, p, cch); break;
-      case HTTP:     i = bufcopy("http://", 7, p, cch); break;
-      case HTTPS:    i = bufcopy("https://", 8, p, cch); break;
-      case MAILTO:   i = bufcopy("mailto:", 7, p, cch); break;
-      case SOCKS:    i = bufcopy("socks:", 6, p, cch); break;
-      case FILE:     i = bufcopy("file:", 5, p, cch); break;
-
-      case OTHER_PROTOCOL:
-      default:
-         i = 0;
-   }
+   size_t i, l;
 
+   psz = ProtocolPrefix(getProtocol(), l);
+   i = bufcopy(psz, l, p, cch);
    p += i;
    cch -= i;
 
-   size_t l = lstrlenA(m_p->ach);
-   i = getHost0(p, cch, l);
+   i = getHost0(p, cch);
    p += i;
    cch -= i;
 
-   i = bufcopy(m_p->ach + l + 1, p, cch);
+   i = bufcopy(getPath(), m_p->cchPath, p, cch);
    return (p - pach) + i;
 }
 
+// Write cch characters to w, replacing each chEscape with pszEscape
+// (if pszEscape isn't NULL).
+//
+static void WriteEscaped(PrintWriter &w, const char *pach, size_t cch,
+                         char chEscape, const char *pszEscape) {
+   if (pszEscape != NULL) {
+      const char *e = pach + cch, *p;
+
+      while ((p = (const char *) memchr(pach, chEscape, e - pach)) != NULL) {
+         w.write(pach, p - pach);
+         w.print(pszEscape);
+         pach = p + 1;
+      }
+
+      cch = e - pach;
+   }
+
+   w.write(pach, cch);
+}
+
+void Href::write(PrintWriter &w, char chEscape, const char *pszEscape) const {
+   const Host *ph = m_p->phost;
+   const char *psz;
+   size_t l;
+
+   // the protocol, "www." and domain parts never need escaping
+   //
+   psz = ProtocolPrefix(getProtocol(), l);
+   w.write(psz, l);
+
+   if (getWWW()) {
+      w.write("www.", 4);
+   }
+
+   WriteEscaped(w, ph->ach, ph->cch, chEscape, pszEscape);
+
+   psz = DomainSuffix(getDomain(), l);
+   w.write(psz, l);
+
+   WriteEscaped(w, m_p->ach, m_p->cchPath, chEscape, pszEscape);
+}
+
 int Href::Compare0(const Data *pd1, const Data *pd2) {
-   int c = (pd1->flags & ~(REFCOUNT_MASK | INTERNED_MASK)) - (pd2->flags & ~(REFCOUNT_MASK | INTERNED_MASK));
+   int c = (pd1->flags & ~INTERNED_MASK) - (pd2->flags & ~INTERNED_MASK);
 
    if (c == 0) {
-      c = lstrcmpA(pd1->ach, pd2->ach);
+      if (pd1->phost != pd2->phost) {
+         c = CompareHost(pd1->phost, pd2->phost);
+      }
 
       if (c == 0) {
-         c = lstrcmpA(pd1->ach + lstrlenA(pd1->ach) + 1,
-                      pd2->ach + lstrlenA(pd2->ach) + 1);
+         c = CompareBytes(pd1->ach, pd1->cchPath, pd2->ach, pd2->cchPath);
       }
    }
 
    return c;
 }
 
+int Href::CompareHost(const Host *ph1, const Host *ph2) {
+   int c = ph1->flags - ph2->flags;
+
+   if (c == 0) {
+      c = CompareBytes(ph1->ach, ph1->cch, ph2->ach, ph2->cch);
+   }
+
+   return c;
+}
+
+int Href::CompareEntry(const Entry *pe1, const Entry *pe2) {
+   return Compare0((const Data *) pe1, (const Data *) pe2);
+}
+
+int Href::CompareHostEntry(const Entry *pe1, const Entry *pe2) {
+   return CompareHost((const Host *) pe1, (const Host *) pe2);
+}
+
+int Href::CompareBytes(const char *pach1, size_t cch1, const char *pach2, size_t cch2) {
+   int c = memcmp(pach1, pach2, cch1 < cch2 ? cch1 : cch2);
+
+   if (c == 0) {
+      c = (int) cch1 - (int) cch2;
+   }
+
+   return c;
+}
+
+/**
+ * Write the canonical form of an http, https or ftp URL into pach:
+ * lower case scheme and host, no default port, no trailing slashes on
+ * the path and upper case hex digits in %-escapes.  The user name and
+ * password before an @ are case sensitive, so they are kept as they
+ * are.  Canonicalizing a canonical URL gives the same URL.
+ *
+ * @return true if the canonical form differs from psz
+ */
+static bool canonicalize(const char *psz, char *pach, size_t cch) {
+   static const struct {
+      const char *pszScheme;
+      size_t      cchScheme;
+      const char *pszPort;
+   } aSchemes[] = {
+      { "http://",   7, "80" },
+      { "https://",  8, "443" },
+      { "ftp://",    6, "21" }
+   };
+
+   size_t i;
+
+   for (i = 0; i < ELEMENTS(aSchemes); i++) {
+      if (strequal(psz, aSchemes[i].pszScheme, aSchemes[i].cchScheme)) {
+         break;
+      }
+   }
+
+   // the canonical form is never longer than the original
+   //
+   if (i == ELEMENTS(aSchemes) || (size_t) lstrlenA(psz) >= cch) {
+      return false;
+   }
+
+   char *p = pach;
+   const char *s = psz + aSchemes[i].cchScheme;
+
+   memcpy(p, aSchemes[i].pszScheme, aSchemes[i].cchScheme);
+   p += aSchemes[i].cchScheme;
+
+   // the host starts after the last @ of the authority, if any
+   //
+   const char *pHost = s;
+
+   for (const char *e = s; *e && *e != '/' && *e != '?' && *e != '#'; e++) {
+      if (*e == '@') {
+         pHost = e + 1;
+      }
+   }
+
+   while (s != pHost) {
+      *p++ = *s++;
+   }
+
+   while (*s && *s != '/' && *s != ':' && *s != '?' && *s != '#') {
+      *p++ = (char) tolower((unsigned char) *s++);
+   }
+
+   if (*s == ':') {
+      const char *e = s + 1;
+
+      while (isdigit((unsigned char) *e)) {
+         e++;
+      }
+
+      if ((*e == 0 || *e == '/' || *e == '?' || *e == '#') &&
+          (size_t) (e - s - 1) == (size_t) lstrlenA(aSchemes[i].pszPort) &&
+          memcmp(s + 1, aSchemes[i].pszPort, e - s - 1) == 0) {
+         s = e;
+      }
+   }
+
+   char *pPath = p;
+
+   while (*s && *s != '?' && *s != '#') {
+      if (s[0] == '%' && isxdigit((unsigned char) s[1]) && isxdigit((unsigned char) s[2])) {
+         *p++ = '%';
+         *p++ = (char) toupper((unsigned char) s[1]);
+         *p++ = (char) toupper((unsigned char) s[2]);
+         s += 3;
+      }
+      else {
+         *p++ = *s++;
+      }
+   }
+
+   while (p != pPath && p[-1] == '/') {
+      p--;
+   }
+
+   lstrcpyA(p, s);
+
+   return strcmp(pach, psz) != 0;
+}
+
 static bool strequal(const char *psz1, const char *psz2, size_t n) {
    for (size_t i = 0; i < n; i++) {
       if (tolower(*psz1) != *psz2++) {
@@ -180,7 +597,7 @@ static bool strequal(const char *psz1, const char *psz2, size_t n) {
    return true;
 }
 
-size_t Href::init(Data *pd, const char *psz) {
+size_t Href::init(Data *pd, Host *ph, size_t &cbHost, const char *psz) {
    unsigned short flags;
 
    if (strequal(psz, "http://", 7)) {
@@ -215,6 +632,13 @@ size_t Href::init(Data *pd, const char *psz) {
       flags = OTHER_PROTOCOL;
    }
 
+   pd->refcount = 0;
+   pd->phost = NULL;
+   pd->pcanon = NULL;
+   pd->flags = flags;
+
+   flags = 0;
+
    if (strequal(psz, "www.", 4)) {
       flags |= WWW_MASK;
       psz += 4;
@@ -250,11 +674,29 @@ size_t Href::init(Data *pd, const char *psz) {
       flags |= OTHER_DOMAIN;
    }
 
-   pd->flags = flags;
-   memcpy(pd->ach, psz, l);
-   pd->ach[l++] = 0;
+   ph->refcount = 0;
+   ph->flags = flags;
+   ph->cch = (unsigned short) l;
+   memcpy(ph->ach, psz, l);
+   ph->ach[l] = 0;
+
+   ph->hash = Hash(0xCBF29CE484222325ui64, &ph->flags, sizeof(ph->flags));
+   ph->hash = Hash(ph->hash, ph->ach, l);
 
-   lstrcpyA(pd->ach + l, p);
+   cbHost = sizeof(Host) + l - 1;
+
+   lstrcpyA(pd->ach, p);
+   pd->cchPath = (unsigned short) lstrlenA(pd->ach);
+
+   return sizeof(Data) + pd->cchPath - 1;
+}
+
+unsigned __int64 Href::Hash(unsigned __int64 h, const void *pv, size_t cb) {
+   const unsigned char *p = (const unsigned char *) pv, *e = p + cb;
+
+   while (p != e) {
+      h = (h ^ *p++) * 0x00000100000001B3ui64;
+   }
 
-   return sizeof(Data) + l + lstrlenA(pd->ach + l) - 1;
+   return h;
 }
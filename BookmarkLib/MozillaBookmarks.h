@@ -53,6 +53,7 @@ public:
 
 private:
     static void         PrintFolder(PrintWriter &w, const BookmarkModel *p, const BookmarkFolder *pbf, int tab);
+    static void         PrintElement(PrintWriter &w, const BookmarkModel *p, const BookmarkObject *pb, int tab);
     static void         PrintBookmark(PrintWriter &w, const Bookmark *pb, int tab);
     static void         WriteHtml(PrintWriter &w, const tchar_t *psz);
     static void         WriteHref(PrintWriter &w, const Href &href);
@@ -59,7 +59,7 @@ void MozillaBookmarks::Write(const BookmarkModel *p, LPCTSTR pszFilename)
     }
 
     w.print(T("</TITLE>\r\n"));
-    PrintFolder(w, p, p, 0);
+    Write(p, w);
     w.close();
     f.commit();
 }
@@ -67,7 +67,27 @@ void MozillaBookmarks::Write(const BookmarkModel *p, LPCTSTR pszFilename)
 //------------------------------------------------------------------------------
 void MozillaBookmarks::Write(const BookmarkModel *p, PrintWriter &w) 
 {
-   PrintFolder(w, p, p, 0);
+    BookmarkWalker walker(p);
+    BookmarkWalker::Event e;
+
+    while ((e = walker.next()) != BookmarkWalker::END)
+    {
+        switch (e)
+        {
+            case BookmarkWalker::ENTER:
+                PrintFolder(w, p, static_cast<const BookmarkFolder*>(walker.get()), walker.depth());
+                break;
+
+            case BookmarkWalker::LEAVE:
+                stab(w, walker.depth());
+                w.print(T("</DL><p>\r\n"));
+                break;
+
+            case BookmarkWalker::ITEM:
+                PrintElement(w, p, walker.get(), walker.depth());
+                break;
+        }
+    }
 }
 
 //------------------------------------------------------------------------------
@@ -113,43 +133,34 @@ void MozillaBookmarks::PrintFolder(PrintWriter &w, const BookmarkModel *p, const
     stab(w, tab);
 
     w.print(T("<DL><p>\r\n"));
+}
 
-    BookmarkVector::const_iterator i = pbf->begin(), max = pbf->end();
-
-    while (i != max) 
+//------------------------------------------------------------------------------
+void MozillaBookmarks::PrintElement(PrintWriter &w, const BookmarkModel *p, const BookmarkObject *pb, int tab) 
+{
+    switch (pb->getKind())
     {
-        const BookmarkObject *pb = (*i);
+        case BookmarkObject::BOOKMARK:
+            PrintBookmark(w, static_cast<const Bookmark*>(pb), tab);
+            break;
 
-        if (pb->isBookmark()) 
-        {
-            PrintBookmark(w, static_cast<const Bookmark*>(pb), tab + 1);
-        }
-        else if (pb->isFolder())
-        {
-            PrintFolder(w, p, static_cast<const BookmarkFolder*>(pb), tab + 1);
-        }
-        else if (pb->isSeparator()) 
-        {
-            stab(w, tab + 1);
+        case BookmarkObject::SEPARATOR:
+            stab(w, tab);
             w.print(T("<HR>\r\n"));
-        }
-        else if (pb->isAlias()) 
+            break;
+
+        case BookmarkObject::ALIAS:
         {
             const BookmarkAlias* pa = static_cast<const BookmarkAlias*>(pb);
             const BookmarkItem* pbmk = p->findId(pa->getId());
 
             if (pbmk && pbmk->isBookmark())
             {
-                PrintBookmark(w, static_cast<const Bookmark*>(pbmk), tab + 1);
+                PrintBookmark(w, static_cast<const Bookmark*>(pbmk), tab);
             }
+            break;
         }
-
-        i++;
     }
-
-    stab(w, tab);
-
-    w.print(T("</DL><p>\r\n"));
 }
 
 //------------------------------------------------------------------------------
@@ -186,25 +197,8 @@ void MozillaBookmarks::PrintBookmark(PrintWriter &w, const Bookmark *pb, int tab
 //------------------------------------------------------------------------------
 void MozillaBookmarks::WriteHref(PrintWriter &w, const Href &href) 
 {
-   char ach[4096], *p = ach;
-   char *e = p + href.format(ach, sizeof(ach));
-
    w.print(T(" HREF=\""));
-
-   while (p != e) 
-   {
-      char ch = *p++;
-
-      if (ch == '"')
-      {
-         w.print(T("%22"));
-      }
-      else 
-      {
-         w.write(ch);
-      }
-   }
-
+   href.write(w, '"', "%22");
    w.write('"');
 }
 
@@ -36,6 +36,7 @@
 using namespace syncit;
 
 static void PrintFolder(PrintWriter &w, const BookmarkModel *p, const BookmarkFolder *pbf, int tab);
+static void PrintElement(PrintWriter &w, const BookmarkModel *p, const BookmarkObject *pb, int tab);
 static void PrintBookmark(PrintWriter &w, const Bookmark *pb, int tab, bool fAlias);
 static void PrintDate(PrintWriter &w, const char *pszAttribute, const DateTime &dt);
 static void WriteHtml(PrintWriter &w, const tchar_t *psz);
@@ -55,13 +56,31 @@ void NetscapeBookmarks::Write(const BookmarkModel *p, LPCTSTR pszFilename) {
       w.print(p->getName());
    }
    w.print(T("</TITLE>\r\n"));
-   PrintFolder(w, p, p, 0);
+   Write(p, w);
    w.close();
    f.commit();
 }
 
 void NetscapeBookmarks::Write(const BookmarkModel *p, PrintWriter &w) {
-   PrintFolder(w, p, p, 0);
+   BookmarkWalker walker(p);
+   BookmarkWalker::Event e;
+
+   while ((e = walker.next()) != BookmarkWalker::END) {
+      switch (e) {
+         case BookmarkWalker::ENTER:
+            PrintFolder(w, p, (const BookmarkFolder *) walker.get(), walker.depth());
+            break;
+
+         case BookmarkWalker::LEAVE:
+            stab(w, walker.depth());
+            w.print(T("</DL><p>\r\n"));
+            break;
+
+         case BookmarkWalker::ITEM:
+            PrintElement(w, p, walker.get(), walker.depth());
+            break;
+      }
+   }
 }
 
 static void PrintFolder(PrintWriter &w, const BookmarkModel *p, const BookmarkFolder *pbf, int tab) {
@@ -102,39 +121,31 @@ static void PrintFolder(PrintWriter &w, const BookmarkModel *p, const BookmarkFo
    stab(w, tab);
 
    w.print(T("<DL><p>\r\n"));
+}
 
-   BookmarkVector::const_iterator i = pbf->begin(), max = pbf->end();
-
-   while (i != max) {
-      const BookmarkObject *pb = (*i);
+static void PrintElement(PrintWriter &w, const BookmarkModel *p, const BookmarkObject *pb, int tab) {
+   switch (pb->getKind()) {
+      case BookmarkObject::BOOKMARK:
+         PrintBookmark(w, (const Bookmark *) pb, tab, false);
+         break;
 
-      if (pb->isBookmark()) {
-         PrintBookmark(w, (const Bookmark *) pb, tab + 1, false);
-      }
-      else if (pb->isFolder()) {
-         PrintFolder(w, p, (const BookmarkFolder *) pb, tab + 1);
-      }
-      else if (pb->isSeparator()) {
-         stab(w, tab + 1);
+      case BookmarkObject::SEPARATOR:
+         stab(w, tab);
          w.print(T("<HR>\r\n"));
-      }
-      else if (pb->isAlias()) {
+         break;
+
+      case BookmarkObject::ALIAS: {
          const BookmarkAlias *pa = (const BookmarkAlias *) pb;
          const BookmarkItem  *pbmk  = p->findId(pa->getId());
 
          if (pbmk == NULL) {
          }
          else if (pbmk->isBookmark()) {
-            PrintBookmark(w, (const Bookmark *) pbmk, tab + 1, true);
+            PrintBookmark(w, (const Bookmark *) pbmk, tab, true);
          }
+         break;
       }
-
-      i++;
    }
-
-   stab(w, tab);
-
-   w.print(T("</DL><p>\r\n"));
 }
 
 static void PrintBookmark(PrintWriter &w, const Bookmark *pb, int tab, bool fAlias) {
@@ -167,22 +178,8 @@ static void PrintBookmark(PrintWriter &w, const Bookmark *pb, int tab, bool fAli
 }
 
 static void WriteHref(PrintWriter &w, const Href &href) {
-   char ach[4096], *p = ach;
-   char *e = p + href.format(ach, sizeof(ach));
-
    w.print(T(" HREF=\""));
-
-   while (p != e) {
-      char ch = *p++;
-
-      if (ch == '"') {
-         w.print(T("%22"));
-      }
-      else {
-         w.write(ch);
-      }
-   }
-
+   href.write(w, '"', "%22");
    w.write('"');
 }
 
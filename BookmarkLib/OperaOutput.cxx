@@ -23,7 +23,6 @@
 using namespace syncit;
 
 static void WriteFolder(const BookmarkFolder *pbf, PrintWriter &w);
-static void WriteFolderElements(const BookmarkFolder *pbf, PrintWriter &w);
 static void WriteBookmark(const Bookmark *pb, PrintWriter &w);
 
 /**
@@ -42,7 +41,7 @@ void OperaHotlist::Write(const BookmarkModel *pb, LPCTSTR pszFilename) {
    f.create(pszFilename);
    w.print("Opera Hotlist version 2.0\r\n\r\n");
 
-   WriteFolderElements(pb, w);
+   Write(pb, w);
 
    w.close();
    f.commit();
@@ -58,7 +57,30 @@ void OperaHotlist::Write(const BookmarkModel *pb, LPCTSTR pszFilename) {
  * @exception IOException on any write error
  */
 void OperaHotlist::Write(const BookmarkModel *pb, PrintWriter &w) {
-   WriteFolderElements(pb, w);
+   BookmarkWalker walker(pb);
+   BookmarkWalker::Event e;
+
+   while ((e = walker.next()) != BookmarkWalker::END) {
+      const BookmarkObject *pbo = walker.get();
+
+      switch (e) {
+         case BookmarkWalker::ENTER:
+            if (walker.depth() > 0) {
+               WriteFolder((const BookmarkFolder *) pbo, w);
+            }
+            break;
+
+         case BookmarkWalker::LEAVE:
+            w.print("-\r\n");
+            break;
+
+         case BookmarkWalker::ITEM:
+            if (pbo->isBookmark()) {
+               WriteBookmark((const Bookmark *) pbo, w);
+            }
+            break;
+      }
+   }
 }
 
 static void WriteFolder(const BookmarkFolder *pbf, PrintWriter &w) {
@@ -79,25 +101,6 @@ static void WriteFolder(const BookmarkFolder *pbf, PrintWriter &w) {
    }
 
    w.print("\r\n");
-
-   WriteFolderElements(pbf, w);
-}
-
-static void WriteFolderElements(const BookmarkFolder *pbf, PrintWriter &w) {
-   BookmarkVector::const_iterator i = pbf->begin(), end = pbf->end();
-
-   while (i != end) {
-      const BookmarkObject *pbo = *i++;
-
-      if (pbo->isFolder()) {
-         WriteFolder((const BookmarkFolder *) pbo, w);
-      }
-      else if (pbo->isBookmark()) {
-         WriteBookmark((const Bookmark *) pbo, w);
-      }
-   }
-
-   w.print("-\r\n");
 }
 
 /**
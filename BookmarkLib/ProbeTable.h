@@ -0,0 +1,92 @@
+/*
+ * BookmarkLib/ProbeTable.h
+ * Copyright (C) 2003  SyncIT.com, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * -----------------
+ * This program is GPL'd.  If you distribute this program or a derivative of
+ * this program publicly you must include the source code.  It is easy
+ * enough to drop me an email requesting a different license, if necessary.
+ *
+ * Description: BookmarkSync client software for Windows
+ * Created:     October 2026
+ * Web site:    http://www.syncit.com
+ */
+#ifndef ProbeTable_H
+#define ProbeTable_H
+
+#include <cstddef>
+
+namespace syncit {
+
+   /**
+    * Helpers for the open-addressing hash tables (linear probing) of
+    * Href::Table, BookmarkFolder::Index and BookmarkAliases.  A table
+    * is cSlots slots, cSlots a power of two, and Traits tells about one:
+    * <pre>
+    *    bool empty(const Slot &slot) const;
+    *    unsigned __int64 hash(const Slot &slot) const;  // picks the home slot
+    *    void clear(Slot &slot) const;                   // make it empty
+    * </pre>
+    */
+
+   // the first empty slot on the probe sequence of hash
+   //
+   template <class Slot, class Traits>
+   size_t ProbeEmpty(const Slot *pslots, size_t cSlots, unsigned __int64 hash, const Traits &traits) {
+      size_t mask = cSlots - 1;
+      size_t i = (size_t) hash & mask;
+
+      while (!traits.empty(pslots[i])) {
+         i = (i + 1) & mask;
+      }
+
+      return i;
+   }
+
+   // Empty slot i.  Entries further along its probe sequence that could
+   // no longer be found past the hole are shifted back into it, so no
+   // tombstones are needed, and entries with the same home slot keep
+   // their order.
+   //
+   template <class Slot, class Traits>
+   void ProbeErase(Slot *pslots, size_t cSlots, size_t i, const Traits &traits) {
+      size_t mask = cSlots - 1;
+      size_t j = i;
+
+      for (;;) {
+         j = (j + 1) & mask;
+
+         if (traits.empty(pslots[j])) {
+            break;
+         }
+
+         size_t k = (size_t) traits.hash(pslots[j]) & mask;
+
+         // move j into the hole unless its home slot k lies
+         // cyclically within (i, j]
+         //
+         if (i <= j ? (k <= i || j < k) : (k <= i && j < k)) {
+            pslots[i] = pslots[j];
+            i = j;
+         }
+      }
+
+      traits.clear(pslots[i]);
+   }
+
+}
+
+#endif /* ProbeTable_H */
@@ -76,20 +76,29 @@ namespace syncit {
       virtual void add0(const BookmarkFolder *p);
       virtual void delFolder(const BookmarkFolder *p);
 
+      virtual bool acceptsMoves() const;
+      virtual void moveBookmark(const Bookmark *pNew, const Bookmark *pOld, const BookmarkPath &pathOld);
+      virtual void moveFolder(const BookmarkFolder *pNew, const BookmarkFolder *pOld, const BookmarkPath &pathOld);
+      virtual void renameItem(const BookmarkItem *pNew, const BookmarkItem *pOld);
+
       virtual void commit();
       // ...BookmarkDifferences
       /////////////////////////
 
    private:
-      void writeBookmark(const char *pszUrl, size_t cchUrl, const DateTime &dt);
+      void writeBookmark(const char *pszUrl, size_t cchUrl, const Href *phref, const DateTime &dt);
       void del();
+      bool move(const BookmarkPath *ppathOld, const tchar_t *pszOld, const tchar_t *pszNew, bool fFolder);
 
       void pushPath(const tchar_t *pszTitle);
+      void pushFolderPath(const tchar_t *pszTitle);
+      void pushItemPath(const tchar_t *pszTitle, bool fFolder);
 
       HWND m_hwndProgress;
 
       char m_achPath[MAX_PATH];
       int  m_i;
+      int  m_iRoot;                 // m_i at the favorites directory
 
       string  m_href;
       DateTime m_dtModified, m_dtInvalid;
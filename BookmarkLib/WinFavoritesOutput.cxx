@@ -105,6 +105,8 @@ WinFavoritesOutput::WinFavoritesOutput(LPCTSTR pszDirectory, HWND hwndProgress)
       m_i--;
    }
 
+   m_iRoot = m_i;
+
    m_dtInvalid = DateTime::now() - DeltaTime::SECOND;
 
    m_hwndProgress = hwndProgress;
@@ -136,7 +138,7 @@ void WinFavoritesOutput::setBookmarkModified(const DateTime &dt) {
 }
 
 void WinFavoritesOutput::endBookmark() {
-   writeBookmark(m_href.c_str(), m_href.size(), m_dtModified);
+   writeBookmark(m_href.c_str(), m_href.size(), NULL, m_dtModified);
 
    popFolder();
 }
@@ -183,12 +185,10 @@ void WinFavoritesOutput::undoCurrent() {
 // BookmarkDifferences...
 //
 void WinFavoritesOutput::addBookmark(const Bookmark *p) {
-   char ach[4096];
-   size_t cch = p->getHref().format(ach, sizeof(ach));
    int i = m_i;
 
    pushPath(p->getName());
-   writeBookmark(ach, cch, p->getModified());
+   writeBookmark(NULL, 0, &p->getHref(), p->getModified());
 
    m_achPath[m_i = i] = 0;
 }
@@ -207,24 +207,14 @@ void WinFavoritesOutput::delBookmark(const Bookmark *p) {
 
 /* virtual */
 void WinFavoritesOutput::pushFolder(const BookmarkFolder *pbf) {
-   pushPath(pbf->getName());
-
-   if (m_achPath[m_i - 1] == '.') {
-      m_achPath[m_i++] = '%';
-      m_achPath[m_i] = 0;
-   }
+   pushFolderPath(pbf->getName());
 }
 
 /* virtual */
 void WinFavoritesOutput::add0(const BookmarkFolder *p) {
    int i = m_i;
 
-   pushPath(p->getName());
-
-   if (m_achPath[m_i - 1] == '.') {
-      m_achPath[m_i++] = '%';
-      m_achPath[m_i] = 0;
-   }
+   pushFolderPath(p->getName());
 
    CreateDirectory(m_achPath, NULL);
    m_achPath[m_i = i] = 0;
@@ -234,18 +224,44 @@ void WinFavoritesOutput::add0(const BookmarkFolder *p) {
 void WinFavoritesOutput::delFolder(const BookmarkFolder *p) {
    int i = m_i;
 
-   pushPath(p->getName());
-
-   if (m_achPath[m_i - 1] == '.') {
-      m_achPath[m_i++] = '%';
-      m_achPath[m_i] = 0;
-   }
+   pushFolderPath(p->getName());
 
    del();
 
    m_achPath[m_i = i] = 0;
 }
 
+/* virtual */
+bool WinFavoritesOutput::acceptsMoves() const {
+   return true;
+}
+
+/* virtual */
+void WinFavoritesOutput::moveBookmark(const Bookmark *pNew, const Bookmark *pOld, const BookmarkPath &pathOld) {
+   if (!move(&pathOld, pOld->getName(), pNew->getName(), false)) {
+      addBookmark(pNew);
+   }
+}
+
+/* virtual */
+void WinFavoritesOutput::moveFolder(const BookmarkFolder *pNew, const BookmarkFolder *pOld, const BookmarkPath &pathOld) {
+   if (!move(&pathOld, pOld->getName(), pNew->getName(), true)) {
+      addFolder(pNew);
+   }
+}
+
+/* virtual */
+void WinFavoritesOutput::renameItem(const BookmarkItem *pNew, const BookmarkItem *pOld) {
+   if (!move(NULL, pOld->getName(), pNew->getName(), !pNew->isBookmark())) {
+      if (pNew->isBookmark()) {
+         addBookmark((const Bookmark *) pNew);
+      }
+      else {
+         addFolder((const BookmarkFolder *) pNew);
+      }
+   }
+}
+
 /* virtual */
 void WinFavoritesOutput::commit() {
 }
@@ -270,6 +286,50 @@ void WinFavoritesOutput::del() {
 
    SHFileOperation(&shfop);
 }
+
+/**
+ * Move the file or directory of the item pszOld, in the folders of
+ * *ppathOld or in the current folder if ppathOld is NULL, to pszNew in
+ * the current folder.  If it can't be moved, the old one is deleted and
+ * false is returned, for the caller to write the new one.
+ */
+bool WinFavoritesOutput::move(const BookmarkPath *ppathOld, const tchar_t *pszOld, const tchar_t *pszNew, bool fFolder) {
+   char achFolder[MAX_PATH];
+   char achFrom[MAX_PATH];
+   int i = m_i;
+
+   memcpy(achFolder, m_achPath, i + 1);
+
+   if (ppathOld != NULL) {
+      BookmarkPath::const_iterator it = ppathOld->begin(), end = ppathOld->end();
+
+      m_i = m_iRoot;
+
+      for (; it != end; it++) {
+         pushFolderPath((*it)->getName());
+      }
+   }
+
+   pushItemPath(pszOld, fFolder);
+   memcpy(achFrom, m_achPath, m_i + 1);
+
+   memcpy(m_achPath, achFolder, i + 1);
+   m_i = i;
+
+   pushItemPath(pszNew, fFolder);
+
+   bool fMoved = MoveFile(achFrom, m_achPath) != FALSE;
+
+   if (!fMoved) {
+      m_i = bufcopy(achFrom, m_achPath, sizeof(m_achPath));
+      del();
+   }
+
+   memcpy(m_achPath, achFolder, i + 1);
+   m_i = i;
+
+   return fMoved;
+}
 // ...BookmarkDifferences
 /////////////////////////
 
@@ -285,7 +345,33 @@ void WinFavoritesOutput::pushPath(const tchar_t *pszTitle) {
    }
 }
 
-void WinFavoritesOutput::writeBookmark(const char *pszUrl, size_t cchUrl, const DateTime &dt) {
+// a folder's directory is never named with a trailing '.'
+//
+void WinFavoritesOutput::pushFolderPath(const tchar_t *pszTitle) {
+   pushPath(pszTitle);
+
+   if (m_achPath[m_i - 1] == '.') {
+      m_achPath[m_i++] = '%';
+      m_achPath[m_i] = 0;
+   }
+}
+
+void WinFavoritesOutput::pushItemPath(const tchar_t *pszTitle, bool fFolder) {
+   if (fFolder) {
+      pushFolderPath(pszTitle);
+   }
+   else {
+      pushPath(pszTitle);
+
+      m_i += bufcopy(URL_SUFFIX, m_achPath + m_i, ELEMENTS(m_achPath) - m_i);
+   }
+}
+
+/**
+ * Write a .URL file for the current path.  The URL is either phref, if
+ * not NULL, or the cchUrl characters at pszUrl.
+ */
+void WinFavoritesOutput::writeBookmark(const char *pszUrl, size_t cchUrl, const Href *phref, const DateTime &dt) {
    bufcopy(URL_SUFFIX, 4, m_achPath + m_i, sizeof(m_achPath) - m_i);
 
    FileOutputStream f;
@@ -298,7 +384,14 @@ void WinFavoritesOutput::writeBookmark(const char *pszUrl, size_t cchUrl, const
       p.print(WindowsFavorites::m_gszInternetShortcut);
       p.print("\r\n"
               "URL=");
-      p.write(pszUrl, cchUrl);
+
+      if (phref != NULL) {
+         phref->write(p);
+      }
+      else {
+         p.write(pszUrl, cchUrl);
+      }
+
       p.print("\r\n");
 
       if (dt.isValid()) {
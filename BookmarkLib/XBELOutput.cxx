@@ -43,7 +43,7 @@ static void PrintFolder(PrintWriter &w, const BookmarkModel *p, const BookmarkFo
 static void PrintBookmark(PrintWriter &w, const Bookmark *pb, int tab);
 static void PrintItemAttributes(PrintWriter &w, const BookmarkItem *pbi);
 static void PrintItemElements(PrintWriter &w, const BookmarkItem *pbi, int tab);
-static void PrintFolderElements(PrintWriter &w, const BookmarkModel *p, const BookmarkVector &v, int tab);
+static void PrintElement(PrintWriter &w, const BookmarkObject *pb, int tab);
 static void stab(PrintWriter &w, int tab);
 
 /* virtual */
@@ -73,7 +73,52 @@ void XBELBookmarks::Write(const BookmarkModel *p, PrintWriter &w) {
    w.print(p->getSeqNo());
    w.write(T('"'));
 
-   PrintFolder(w, p, p, 1);
+   BookmarkWalker walker(p);
+   BookmarkWalker::Event e;
+
+   while ((e = walker.next()) != BookmarkWalker::END) {
+      const BookmarkObject *pb = walker.get();
+      int tab = walker.depth();
+
+      switch (e) {
+         case BookmarkWalker::ENTER: {
+            const BookmarkFolder *pbf = (const BookmarkFolder *) pb;
+
+            if (tab > 0) {
+               stab(w, tab);
+
+               if (pbf->isSubscription()) {
+                  w.print(T("<subscription seqno=\""));
+                  w.print(((const BookmarkSubscription *) pbf)->getSeqNo());
+                  w.write(T('"'));
+               }
+               else {
+                  w.print(T("<folder"));
+               }
+            }
+
+            PrintFolder(w, p, pbf, tab + 1);
+            break;
+         }
+
+         case BookmarkWalker::LEAVE:
+            if (tab > 0) {
+               stab(w, tab);
+
+               if (((const BookmarkFolder *) pb)->isSubscription()) {
+                  w.print(T("</subscription>\r\n"));
+               }
+               else {
+                  w.print(T("</folder>\r\n"));
+               }
+            }
+            break;
+
+         case BookmarkWalker::ITEM:
+            PrintElement(w, pb, tab);
+            break;
+      }
+   }
 
    w.print(T("</xbel>\r\n"));
 }
@@ -95,57 +140,28 @@ static void PrintFolder(PrintWriter &w, const BookmarkModel *p, const BookmarkFo
    w.print(T(">\r\n"));
 
    PrintItemElements(w, pbf, tab);
-   PrintFolderElements(w, p, pbf->elements(), tab);
 }
 
-static void PrintFolderElements(PrintWriter &w, const BookmarkModel *p, const BookmarkVector &v, int tab) {
-   BookmarkVector::const_iterator i = v.begin(), max = v.end();
-
-   while (i != max) {
-      const BookmarkObject *pb = (*i);
-
-      if (pb->isBookmark()) {
+static void PrintElement(PrintWriter &w, const BookmarkObject *pb, int tab) {
+   switch (pb->getKind()) {
+      case BookmarkObject::BOOKMARK:
          PrintBookmark(w, (const Bookmark *) pb, tab);
-      }
-      else if (pb->isFolder()) {
-         const BookmarkFolder *pbf = (const BookmarkFolder *) pb;
+         break;
 
-         stab(w, tab);
-         if (pbf->isSubscription()) {
-            const BookmarkSubscription *pbs = (const BookmarkSubscription *) pbf;
-
-            w.print(T("<subscription seqno=\""));
-            w.print(pbs->getSeqNo());
-            w.write(T('"'));
-         }
-         else {
-            w.print(T("<folder"));
-         }
-
-         PrintFolder(w, p, pbf, tab + 1);
-         stab(w, tab);
-
-         if (pbf->isSubscription()) {
-            w.print(T("</subscription>\r\n"));
-         }
-         else {
-            w.print(T("</folder>\r\n"));
-         }
-      }
-      else if (pb->isSeparator()) {
+      case BookmarkObject::SEPARATOR:
          stab(w, tab);
          w.print(T("<separator/>\r\n"));
-      }
-      else if (pb->isAlias()) {
+         break;
+
+      case BookmarkObject::ALIAS: {
          const BookmarkAlias *pa = (const BookmarkAlias *) pb;
 
          stab(w, tab);
          w.print(T("<alias"));
          XMLWriteAttribute(w, T("ref"), pa->getId());
          w.print(T("/>\r\n"));
+         break;
       }
-
-      i++;
    }
 }
 
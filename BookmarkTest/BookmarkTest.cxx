@@ -0,0 +1,1550 @@
+/*
+ * BookmarkTest/BookmarkTest.cxx
+ * Copyright (C) 2003  SyncIT.com, Inc.
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+ * -----------------
+ * This program is GPL'd.  If you distribute this program or a derivative of
+ * this program publicly you must include the source code.  It is easy
+ * enough to drop me an email requesting a different license, if necessary.
+ *
+ * Description: BookmarkSync client software for Windows
+ * Created:     October 2026
+ * Web site:    http://www.syncit.com
+ *
+ *    Test driver for BookmarkLib: checks its tables and algorithms on
+ *    small cases, then times them on big synthetic bookmark sets.
+ *
+ *       BookmarkTest           checks, then benchmarks
+ *       BookmarkTest -check    checks only
+ *
+ *    The exit code is the number of failed checks.
+ */
+#pragma warning( disable : 4786 )
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <set>
+#include <string>
+#include <vector>
+
+#include "BookmarkLib/BookmarkModel.h"
+#include "BookmarkLib/BookmarkEditor.h"
+#include "BookmarkLib/BrowserBookmarks.h"
+
+#include "SyncLib/BufferedOutputStream.h"
+#include "SyncLib/PrintWriter.h"
+
+using namespace syncit;
+
+static int gcFailed = 0;
+
+#define CHECK(f) Check((f), #f, __LINE__)
+
+static void Check(bool f, const char *pszWhat, int line) {
+   if (!f) {
+      printf("BookmarkTest.cxx(%d): check failed: %s\n", line, pszWhat);
+      gcFailed++;
+   }
+}
+
+// Milliseconds between calls to lap()
+//
+class Stopwatch {
+public:
+   Stopwatch() {
+      m_dw = ::GetTickCount();
+   }
+
+   unsigned long lap() {
+      DWORD dw = ::GetTickCount();
+      unsigned long ul = dw - m_dw;
+
+      m_dw = dw;
+      return ul;
+   }
+
+private:
+   DWORD m_dw;
+};
+
+static const char *const gapszWords[] = {
+   "apple", "bridge", "candle", "desert", "engine", "forest", "garden", "harbor",
+   "island", "jungle", "kettle", "ladder", "meadow", "needle", "orange", "pepper",
+   "quartz", "river", "saddle", "timber", "umbrella", "valley", "window", "yellow",
+   "Atlas", "Beacon", "Cobalt", "Delta", "Ember", "Falcon", "Glacier", "Horizon"
+};
+
+// a pseudo-random word for i, the same every run
+//
+static const char *Word(unsigned long i) {
+   i = i * 2654435761ul;
+   return gapszWords[(i >> 16) % ELEMENTS(gapszWords)];
+}
+
+// The i'th synthetic URL: about a thousand hosts, with www. and .com
+// on most of them, as in real bookmark files.
+//
+static void MakeUrl(char *pach, unsigned long i) {
+   unsigned long ulHost = i % 997;
+
+   wsprintf(pach, ulHost % 5 == 0 ? "https://%s%lu.org/%s/%lu.html" : "http://www.%s%lu.com/%s/%lu.html",
+            Word(ulHost), ulHost, Word(i + 1), i);
+}
+
+// psz, which is plain ASCII, as a tchar_t string
+//
+class Widen {
+public:
+   Widen(const char *psz) {
+      size_t i;
+
+      for (i = 0; psz[i] != '\0' && i < ELEMENTS(m_ach) - 1; i++) {
+         m_ach[i] = (tchar_t) (unsigned char) psz[i];
+      }
+
+      m_ach[i] = 0;
+   }
+
+   operator const tchar_t *() const {
+      return m_ach;
+   }
+
+private:
+   tchar_t m_ach[256];
+};
+
+// The shape of a synthetic tree: cBookmarks bookmarks in every folder,
+// and cFolders subfolders in every folder less than cLevels deep.
+//
+struct Shape {
+   int cLevels;
+   int cFolders;
+   int cBookmarks;
+
+   unsigned long getNodeCount() const {
+      unsigned long ulFolders = 1, ul = 1;
+
+      for (int i = 0; i < cLevels; i++) {
+         ul *= cFolders;
+         ulFolders += ul;
+      }
+
+      return ulFolders * (cBookmarks + 1);
+   }
+};
+
+// Add a bookmark to the current folder of bs.
+//
+static void AddBookmark(BookmarkSink &bs, const char *pszName, const char *pszUrl) {
+   bs.startBookmark();
+   bs.setName(Widen(pszName));
+   bs.setBookmarkHref(pszUrl);
+   bs.endBookmark();
+}
+
+// Add a folder to the current folder of bs, and make it the current
+// folder until EndFolder().
+//
+static void StartFolder(BookmarkSink &bs, const char *pszName) {
+   bs.startFolder();
+   bs.setName(Widen(pszName));
+   bs.pushFolder();
+}
+
+static void EndFolder(BookmarkSink &bs) {
+   bs.popFolder();
+   bs.endFolder();
+}
+
+// Fill the current folder of bs, numbering items from ul on.
+//
+static void BuildFolder(BookmarkSink &bs, const Shape &shape, int nLevel, unsigned long &ul) {
+   char achName[64], achUrl[256];
+   int i;
+
+   for (i = 0; i < shape.cBookmarks; i++, ul++) {
+      wsprintf(achName, "%s %lu", Word(ul), ul);
+      MakeUrl(achUrl, ul);
+      AddBookmark(bs, achName, achUrl);
+   }
+
+   if (nLevel < shape.cLevels) {
+      for (i = 0; i < shape.cFolders; i++, ul++) {
+         wsprintf(achName, "%s %lu", Word(ul), ul);
+         StartFolder(bs, achName);
+         BuildFolder(bs, shape, nLevel + 1, ul);
+         EndFolder(bs);
+      }
+   }
+}
+
+// The n'th subfolder of pbf, or NULL
+//
+static BookmarkFolder *NthFolder(const BookmarkFolder *pbf, int n) {
+   for (BookmarkVector::const_iterator i = pbf->begin(); i != pbf->end(); i++) {
+      if (*i != NULL && (*i)->isFolder() && n-- == 0) {
+         return (BookmarkFolder *) *i;
+      }
+   }
+
+   return NULL;
+}
+
+// A new bookmark on the heap, as edits add them
+//
+static Bookmark *NewBookmark(const char *pszName, const char *pszUrl) {
+   Bookmark *pb = NEW Bookmark();
+
+   pb->setName(Widen(pszName));
+   pb->setHref(pszUrl);
+   return pb;
+}
+
+/**
+ * Builds a tree on the heap, one plain new per node, as models were
+ * built before they had arenas and as edits still build them.
+ */
+class HeapSink : public BookmarkSink {
+public:
+   HeapSink(BookmarkModel *pm) {
+      m_pCurrentItem = pm;
+      m_pCurrentFolder = NULL;
+   }
+
+   void setName(const tchar_t *psz) {
+      ((BookmarkItem *) m_pCurrentItem)->setName(psz);
+   }
+
+   void startBookmark() {
+      m_pCurrentItem = NEW Bookmark();
+   }
+
+   void setBookmarkHref(const char *psz) {
+      ((Bookmark *) m_pCurrentItem)->setHref(psz);
+   }
+
+   void endBookmark() {
+      m_pCurrentFolder->add(m_pCurrentItem);
+   }
+
+   void startFolder() {
+      m_pCurrentItem = NEW BookmarkFolder();
+   }
+
+   void pushFolder() {
+      m_stack.push_back(m_pCurrentFolder);
+      m_pCurrentFolder = (BookmarkFolder *) m_pCurrentItem;
+   }
+
+   void popFolder() {
+      m_pCurrentItem = m_pCurrentFolder;
+      m_pCurrentFolder = m_stack.back();
+      m_stack.pop_back();
+   }
+
+   void endFolder() {
+      m_pCurrentFolder->add(m_pCurrentItem);
+   }
+
+   void startSubscription() {}
+   void endSubscription() {}
+   void undoCurrent() {}
+
+private:
+   BookmarkObject *m_pCurrentItem;
+   BookmarkFolder *m_pCurrentFolder;
+   vector<BookmarkFolder *> m_stack;
+};
+
+// A new model of the given shape, its nodes from its arena if fArena,
+// else from the heap.
+//
+static BookmarkModel *BuildModel(const Shape &shape, bool fArena = true) {
+   BookmarkModel *pm = NEW BookmarkModel();
+   unsigned long ul = 0;
+
+   if (fArena) {
+      BookmarkContext bc(pm, NULL);
+
+      bc.pushFolder();
+      BuildFolder(bc, shape, 0, ul);
+      bc.popFolder();
+   }
+   else {
+      HeapSink hs(pm);
+
+      hs.pushFolder();
+      BuildFolder(hs, shape, 0, ul);
+      hs.popFolder();
+   }
+
+   return pm;
+}
+
+/**
+ * The Href intern table: equal URLs share one Data, different ones
+ * don't, and what is interned formats back as it came in, through
+ * the table growing and entries being erased.
+ */
+static void CheckHrefs() {
+   const unsigned long C = 20000;
+   vector<Href> v;
+   char ach[256], achFormat[256];
+   unsigned long i;
+
+   v.reserve(C);
+
+   for (i = 0; i < C; i++) {
+      MakeUrl(ach, i);
+      v.push_back(Href::Intern(ach));
+   }
+
+   bool fSame = true, fFormat = true;
+
+   for (i = 0; i < C; i++) {
+      MakeUrl(ach, i);
+
+      Href href = Href::Intern(ach);
+
+      fSame = fSame && href == v[i] && href.getHash() == v[i].getHash();
+
+      size_t cch = href.format(achFormat, sizeof(achFormat) - 1);
+
+      achFormat[cch] = 0;
+      fFormat = fFormat && strcmp(ach, achFormat) == 0;
+   }
+
+   CHECK(fSame);
+   CHECK(fFormat);
+   CHECK(v[0] != v[1]);
+   CHECK(v[0].sameHost(v[997]));
+   CHECK(!v[0].sameHost(v[1]));
+
+   // drop every other one, so erasing has to keep the rest findable
+   //
+   for (i = 0; i < C; i += 2) {
+      v[i] = Href();
+   }
+
+   bool fKept = true;
+
+   for (i = 1; i < C; i += 2) {
+      MakeUrl(ach, i);
+      fKept = fKept && Href::Intern(ach) == v[i];
+   }
+
+   CHECK(fKept);
+
+   CHECK(Href::Intern("http://www.syncit.com/") == Href::Intern("http://www.syncit.com/"));
+   CHECK(Href::Intern("http://www.syncit.com/") != Href::Intern("http://www.syncit.com/a"));
+   CHECK(Href::Intern("http://www.syncit.com/") != Href::Intern("https://www.syncit.com/"));
+}
+
+static int Sign(int i) {
+   return i < 0 ? -1 : i > 0 ? 1 : 0;
+}
+
+/**
+ * Name atoms: one per distinct string, compared ignoring case exactly
+ * as tstricmp compares, including names whose sort keys are equal and
+ * characters that sort differently folded and unfolded.
+ */
+static void CheckNames() {
+   static const char *const apsz[] = {
+      "Glacier", "glacier", "GLACIER", "Glacier National Park", "glacier national parks",
+      "Glacier_Park", "GlacierZ", "a", "A", "ab", "a_", "aZ", "Z", "_", "[", "",
+      "news", "News and Weather", "news and weather", "abcdefgh", "abcdefghi", "ABCDEFGHI"
+   };
+   const size_t C = ELEMENTS(apsz);
+   BookmarkName an[C], name;
+   size_t i, j;
+
+   for (i = 0; i < C; i++) {
+      an[i].assign(Widen(apsz[i]));
+   }
+
+   bool fSame = true, fCompare = true, fHash = true;
+
+   for (i = 0; i < C; i++) {
+      Widen wi(apsz[i]);
+
+      name.assign(wi);
+      fSame = fSame && name == an[i] && tstrcmp(name.c_str(), wi) == 0;
+      fHash = fHash && BookmarkName::FoldedHash(wi) == an[i].getFoldedHash();
+
+      for (j = 0; j < C; j++) {
+         Widen wj(apsz[j]);
+         int c = tstricmp(wi, wj);
+
+         fCompare = fCompare && Sign(an[i].compareIgnoreCase(an[j])) == Sign(c) &&
+                    an[i].equalsIgnoreCase(an[j]) == (c == 0) &&
+                    (an[i] == an[j]) == (i == j);
+
+         if (c == 0) {
+            fHash = fHash && an[i].getFoldedHash() == an[j].getFoldedHash();
+         }
+      }
+   }
+
+   CHECK(fSame);
+   CHECK(fCompare);
+   CHECK(fHash);
+
+   // many atoms, then half of them released: the rest stay findable
+   //
+   const unsigned long CMANY = 5000;
+   vector<BookmarkName> v(CMANY);
+   char ach[64];
+   unsigned long ul;
+
+   for (ul = 0; ul < CMANY; ul++) {
+      wsprintf(ach, "%s %lu", Word(ul), ul);
+      v[ul].assign(Widen(ach));
+   }
+
+   for (ul = 0; ul < CMANY; ul += 2) {
+      v[ul].release();
+   }
+
+   bool fKept = true;
+
+   for (ul = 1; ul < CMANY; ul += 2) {
+      wsprintf(ach, "%s %lu", Word(ul), ul);
+      name.assign(Widen(ach));
+      fKept = fKept && name == v[ul];
+   }
+
+   CHECK(fKept);
+}
+
+// Interning as Href::Table did before it was a hash table: a set of
+// strings ordered by strcmp.
+//
+struct StrLess {
+   bool operator()(const char *psz1, const char *psz2) const {
+      return strcmp(psz1, psz2) < 0;
+   }
+};
+
+/**
+ * Intern 1M synthetic URLs, each one twice as when a model is read
+ * and then its copy, into a sorted set and into the Href tables.
+ */
+static void BenchIntern() {
+   const unsigned long C = 1000000;
+   vector<string> urls(C);
+   char ach[256];
+   unsigned long i;
+   int n;
+
+   for (i = 0; i < C; i++) {
+      MakeUrl(ach, i);
+      urls[i] = ach;
+   }
+
+   Stopwatch sw;
+
+   {
+      typedef set<const char *, StrLess> Set;
+      Set interned;
+
+      for (n = 0; n < 2; n++) {
+         for (i = 0; i < C; i++) {
+            const char *psz = urls[i].c_str();
+
+            if (interned.find(psz) == interned.end()) {
+               interned.insert(stralloc(psz));
+            }
+         }
+      }
+
+      unsigned long ulSet = sw.lap();
+
+      for (Set::iterator j = interned.begin(); j != interned.end(); j++) {
+         u_free((void *) *j);
+      }
+
+      printf("intern %lu URLs: sorted set %lu ms", C, ulSet);
+   }
+
+   sw.lap();
+
+   {
+      vector<Href> v;
+
+      v.reserve(C);
+
+      for (i = 0; i < C; i++) {
+         v.push_back(Href::Intern(urls[i].c_str()));
+      }
+
+      for (i = 0; i < C; i++) {
+         Href::Intern(urls[i].c_str());
+      }
+
+      printf(", hash table %lu ms\n", sw.lap());
+   }
+}
+
+/**
+ * A model built in its arena holds the same bookmarks as one built on
+ * the heap, and its nodes really come from the arena.
+ */
+static void CheckArena() {
+   Shape shape = { 2, 3, 4 };
+   BookmarkModel *pmArena = BuildModel(shape, true);
+   BookmarkModel *pmHeap = BuildModel(shape, false);
+
+   CHECK(pmArena->getBookmarkCount() == 4 * 13);
+   CHECK(pmArena->getContentHash() == pmHeap->getContentHash());
+   CHECK((*pmArena->begin())->getArena() == pmArena->getArena());
+   CHECK((*pmHeap->begin())->getArena() == NULL);
+
+   BookmarkObject::Detach(pmArena);
+   BookmarkObject::Detach(pmHeap);
+}
+
+/**
+ * Copy-on-write: a copy of a model shares its folders, and an edit to
+ * the copy replaces only the folders on the path to the edit.  With
+ * two folders of the same name, only the one holding what is removed
+ * is copied.
+ */
+static void CheckCopyOnWrite() {
+   Shape shape = { 2, 3, 4 };
+   BookmarkModel *pm = BuildModel(shape);
+   BookmarkModel *pmCopy = NEW BookmarkModel(*pm);
+   unsigned __int64 hash = pm->getContentHash();
+   bool fShared = pm->elements().size() == pmCopy->elements().size();
+   BookmarkVector::const_iterator i, j;
+
+   for (i = pm->begin(), j = pmCopy->begin(); fShared && i != pm->end(); i++, j++) {
+      fShared = *i == *j && (*i)->isShared();
+   }
+
+   CHECK(fShared);
+
+   BookmarkFolder *pF1 = NthFolder(pm, 1), *pF2 = NthFolder(pm, 2);
+   BookmarkFolder *pG0 = NthFolder(pF1, 0), *pG1 = NthFolder(pF1, 1);
+   Bookmark *pb = NewBookmark("added", "http://www.syncit.com/added");
+
+   {
+      BookmarkEditor editor(pmCopy);
+
+      editor.pushFolder(pF1);
+      editor.pushFolder(pG0);
+      editor.addBookmark(pb);
+      editor.popFolder();
+      editor.popFolder();
+   }
+
+   BookmarkObject::Detach(pb);
+
+   BookmarkFolder *pF1Copy = NthFolder(pmCopy, 1);
+
+   CHECK(pF1Copy != pF1);
+   CHECK(NthFolder(pF1Copy, 0) != pG0);
+   CHECK(NthFolder(pF1Copy, 1) == pG1);
+   CHECK(NthFolder(pmCopy, 0) == NthFolder(pm, 0));
+   CHECK(NthFolder(pmCopy, 2) == pF2);
+   CHECK(pm->getContentHash() == hash);
+   CHECK(pmCopy->getBookmarkCount() == pm->getBookmarkCount() + 1);
+   CHECK(pG0->findBookmark(T("added")) == NULL);
+   CHECK(NthFolder(pF1Copy, 0)->findBookmark(T("added")) != NULL);
+
+   BookmarkObject::Detach(pmCopy);
+   BookmarkObject::Detach(pm);
+
+   // two folders named Dup: only the second has the bookmark to remove
+   //
+   pm = NEW BookmarkModel();
+
+   {
+      BookmarkContext bc(pm, NULL);
+
+      bc.pushFolder();
+      StartFolder(bc, "Dup");
+      AddBookmark(bc, "one", "http://www.syncit.com/1");
+      EndFolder(bc);
+      StartFolder(bc, "Dup");
+      AddBookmark(bc, "two", "http://www.syncit.com/2");
+      EndFolder(bc);
+      bc.popFolder();
+   }
+
+   pmCopy = NEW BookmarkModel(*pm);
+   pF1 = NthFolder(pm, 0);
+   pF2 = NthFolder(pm, 1);
+
+   {
+      BookmarkEditor editor(pmCopy);
+
+      editor.pushFolder(pF1);
+      editor.delBookmark(pF2->findBookmark(T("two")));
+      editor.popFolder();
+   }
+
+   CHECK(NthFolder(pmCopy, 0) == pF1);
+   CHECK(NthFolder(pmCopy, 1) != pF2);
+   CHECK(NthFolder(pmCopy, 1)->getBookmarkCount() == 0);
+   CHECK(pF2->getBookmarkCount() == 1);
+   CHECK(pmCopy->getBookmarkCount() == 1);
+
+   BookmarkObject::Detach(pmCopy);
+   BookmarkObject::Detach(pm);
+}
+
+// psz upper-cased in place, for ASCII names
+//
+static char *Upper(char *psz) {
+   for (char *p = psz; *p != '\0'; p++) {
+      *p = (char) toupper((unsigned char) *p);
+   }
+
+   return psz;
+}
+
+/**
+ * The per-folder Index: a folder big enough to have one finds children
+ * by name ignoring case, tells bookmarks from folders of the same name,
+ * and stays right as children are added and removed.
+ */
+static void CheckIndex() {
+   const unsigned long CBOOKMARKS = 100, CFOLDERS = 10;
+   BookmarkModel *pm = NEW BookmarkModel();
+   char achName[64], achUrl[256];
+   unsigned long ul;
+
+   {
+      BookmarkContext bc(pm, NULL);
+
+      bc.pushFolder();
+      StartFolder(bc, "Big");
+
+      for (ul = 0; ul < CBOOKMARKS; ul++) {
+         wsprintf(achName, "%s %lu", Word(ul), ul);
+         MakeUrl(achUrl, ul);
+         AddBookmark(bc, achName, achUrl);
+      }
+
+      for (ul = 0; ul < CFOLDERS; ul++) {
+         wsprintf(achName, "Sub %lu", ul);
+         StartFolder(bc, achName);
+         EndFolder(bc);
+      }
+
+      AddBookmark(bc, "Same", "http://www.syncit.com/same");
+      StartFolder(bc, "Same");
+      EndFolder(bc);
+
+      EndFolder(bc);
+      bc.popFolder();
+   }
+
+   BookmarkFolder *pbf = NthFolder(pm, 0);
+   bool fFound = true;
+
+   for (ul = 0; ul < CBOOKMARKS; ul++) {
+      wsprintf(achName, "%s %lu", Word(ul), ul);
+
+      Bookmark *pb = pbf->findBookmark(Widen(Upper(achName)));
+
+      fFound = fFound && pb != NULL && pb == pbf->elements()[ul] &&
+               pbf->findBookmarkFolder(Widen(achName)) == NULL;
+   }
+
+   for (ul = 0; ul < CFOLDERS; ul++) {
+      wsprintf(achName, "sub %lu", ul);
+      fFound = fFound && pbf->findBookmarkFolder(Widen(achName)) == NthFolder(pbf, ul) &&
+               pbf->findBookmark(Widen(achName)) == NULL;
+   }
+
+   CHECK(fFound);
+   CHECK(pbf->findBookmark(T("missing")) == NULL);
+   CHECK(pbf->findBookmarkFolder(T("missing")) == NULL);
+   CHECK(pbf->findBookmark(T("SAME")) != NULL);
+   CHECK(pbf->findBookmarkFolder(T("same")) == NthFolder(pbf, CFOLDERS));
+
+   // added after the index is built
+   //
+   pbf->add(NewBookmark("Late Addition", "http://www.syncit.com/late"));
+
+   CHECK(pbf->findBookmark(T("late addition")) != NULL);
+
+   // removed, before and after the holes are compacted
+   //
+   {
+      BookmarkEditor editor(pm);
+
+      editor.pushFolder(pbf);
+
+      for (ul = 0; ul < CBOOKMARKS; ul += 2) {
+         editor.delBookmark((const Bookmark *) pbf->elements()[ul]);
+      }
+
+      wsprintf(achName, "%s %lu", Word(0), 0ul);
+      CHECK(pbf->findBookmark(Widen(achName)) == NULL);
+
+      editor.popFolder();
+   }
+
+   CHECK(!pbf->hasHoles());
+
+   bool fRemoved = true;
+
+   for (ul = 0; ul < CBOOKMARKS; ul++) {
+      wsprintf(achName, "%s %lu", Word(ul), ul);
+      fRemoved = fRemoved && (pbf->findBookmark(Widen(achName)) == NULL) == (ul % 2 == 0);
+   }
+
+   CHECK(fRemoved);
+   CHECK(pbf->findBookmark(T("Late Addition")) != NULL);
+   CHECK(pbf->findBookmarkFolder(T("Sub 9")) != NULL);
+   CHECK(pm->getBookmarkCount() == CBOOKMARKS / 2 + 2);
+
+   BookmarkObject::Detach(pm);
+}
+
+// A model with one folder holding c bookmarks and c subfolders, named
+// from two words each, so that about a thousand names repeat, in
+// different cases, and many share their first characters.
+//
+static BookmarkModel *BuildSortModel(unsigned long c) {
+   BookmarkModel *pm = NEW BookmarkModel();
+   BookmarkContext bc(pm, NULL);
+   char achName[64], achUrl[256];
+   unsigned long ul;
+
+   bc.pushFolder();
+   StartFolder(bc, "Sort");
+
+   for (ul = 0; ul < c; ul++) {
+      wsprintf(achName, "%s %s", Word(ul), Word(ul * 31 + 7));
+      MakeUrl(achUrl, ul);
+      AddBookmark(bc, ul % 4 == 0 ? Upper(achName) : achName, achUrl);
+   }
+
+   for (ul = 0; ul < c; ul++) {
+      wsprintf(achName, "%s %s", Word(ul + 5), Word(ul * 17 + 3));
+      StartFolder(bc, ul % 4 == 0 ? Upper(achName) : achName);
+      EndFolder(bc);
+   }
+
+   EndFolder(bc);
+   bc.popFolder();
+
+   return pm;
+}
+
+/**
+ * SortBookmarks() and SortBookmarkFolders() order a folder as sort()
+ * with BookmarkLess, BookmarkEquivalentLess and BookmarkFolderLess do.
+ */
+static void CheckSort() {
+   BookmarkModel *pm = BuildSortModel(2000);
+   vector<const Bookmark *> vb, vbSorted;
+   vector<const BookmarkFolder *> vf, vfSorted;
+   size_t i;
+
+   ExtractFromFolder(NthFolder(pm, 0), vb, vf);
+
+   vbSorted = vb;
+   sort(vb.begin(), vb.end(), BookmarkLess);
+   SortBookmarks(vbSorted);
+
+   bool fBookmarks = vb.size() == vbSorted.size();
+
+   for (i = 0; fBookmarks && i < vb.size(); i++) {
+      fBookmarks = BookmarkCompare(vb[i], vbSorted[i]) == 0;
+   }
+
+   CHECK(fBookmarks);
+
+   sort(vb.begin(), vb.end(), BookmarkEquivalentLess);
+   SortBookmarks(vbSorted, true);
+
+   for (i = 0; fBookmarks && i < vb.size(); i++) {
+      fBookmarks = BookmarkCompare(vb[i], vbSorted[i], true) == 0;
+   }
+
+   CHECK(fBookmarks);
+
+   vfSorted = vf;
+   sort(vf.begin(), vf.end(), BookmarkFolderLess);
+   SortBookmarkFolders(vfSorted);
+
+   bool fFolders = vf.size() == vfSorted.size();
+
+   for (i = 0; fFolders && i < vf.size(); i++) {
+      fFolders = BookmarkFolderCompare(vf[i], vfSorted[i]) == 0;
+   }
+
+   CHECK(fFolders);
+
+   BookmarkObject::Detach(pm);
+}
+
+/**
+ * Sort a folder of 10k bookmarks and 10k subfolders, over and over as
+ * diff() does every time it meets it, with sort() and then with the
+ * keyed sorts.
+ */
+static void BenchSort() {
+   const unsigned long C = 10000;
+   const int N = 20;
+   BookmarkModel *pm = BuildSortModel(C);
+   vector<const Bookmark *> vbFolder, vb;
+   vector<const BookmarkFolder *> vfFolder, vf;
+   unsigned long aul[2][2];
+   int n;
+
+   ExtractFromFolder(NthFolder(pm, 0), vbFolder, vfFolder);
+
+   Stopwatch sw;
+
+   for (n = 0; n < N; n++) {
+      vb = vbFolder;
+      sort(vb.begin(), vb.end(), BookmarkLess);
+   }
+
+   aul[0][0] = sw.lap();
+
+   for (n = 0; n < N; n++) {
+      vb = vbFolder;
+      SortBookmarks(vb);
+   }
+
+   aul[0][1] = sw.lap();
+
+   for (n = 0; n < N; n++) {
+      vf = vfFolder;
+      sort(vf.begin(), vf.end(), BookmarkFolderLess);
+   }
+
+   aul[1][0] = sw.lap();
+
+   for (n = 0; n < N; n++) {
+      vf = vfFolder;
+      SortBookmarkFolders(vf);
+   }
+
+   aul[1][1] = sw.lap();
+
+   printf("sort %lu bookmarks x%d: sort() %lu ms, SortBookmarks %lu ms\n", C, N, aul[0][0], aul[0][1]);
+   printf("sort %lu folders x%d: sort() %lu ms, SortBookmarkFolders %lu ms\n", C, N, aul[1][0], aul[1][1]);
+
+   BookmarkObject::Detach(pm);
+}
+
+/**
+ * The alias id registry: ids defined while a model is read are found,
+ * a copy of the model starts with the same ids, and removing some ids
+ * from the copy leaves the rest findable and the original alone.
+ */
+static void CheckAliases() {
+   const unsigned long C = 5000;
+   BookmarkModel *pm = NEW BookmarkModel();
+   char achName[64], achUrl[256];
+   unsigned long ul;
+
+   {
+      BookmarkContext bc(pm, NULL);
+
+      bc.pushFolder();
+
+      for (ul = 0; ul < C; ul++) {
+         wsprintf(achName, "%s %lu", Word(ul), ul);
+         MakeUrl(achUrl, ul);
+         bc.startBookmark();
+         bc.setName(Widen(achName));
+         bc.setBookmarkHref(achUrl);
+         wsprintf(achName, "rdf:#$%lu", ul);
+         bc.setId(Widen(achName));
+         bc.endBookmark();
+      }
+
+      bc.popFolder();
+   }
+
+   BookmarkModel *pmCopy = NEW BookmarkModel(*pm);
+   bool fFound = true;
+
+   for (ul = 0; ul < C; ul++) {
+      wsprintf(achName, "rdf:#$%lu", ul);
+      fFound = fFound && pm->findId(Widen(achName)) == pm->elements()[ul] &&
+               pmCopy->findId(Widen(achName)) == pm->elements()[ul];
+   }
+
+   CHECK(fFound);
+   CHECK(pm->findId(T("rdf:#$missing")) == NULL);
+
+   for (ul = 0; ul < C; ul += 2) {
+      wsprintf(achName, "rdf:#$%lu", ul);
+      pmCopy->removeAliasId(Widen(achName));
+   }
+
+   bool fRemoved = true;
+
+   for (ul = 0; ul < C; ul++) {
+      wsprintf(achName, "rdf:#$%lu", ul);
+      fRemoved = fRemoved && pm->findId(Widen(achName)) == pm->elements()[ul] &&
+                 (pmCopy->findId(Widen(achName)) == NULL) == (ul % 2 == 0);
+   }
+
+   CHECK(fRemoved);
+
+   // an id defined again, for another item
+   //
+   BookmarkItem *pItem = (BookmarkItem *) pm->elements()[1];
+
+   pmCopy->defineAliasId(T("rdf:#$0"), pItem);
+   CHECK(pmCopy->findId(T("rdf:#$0")) == pItem);
+   CHECK(pm->findId(T("rdf:#$0")) == pm->elements()[0]);
+
+   BookmarkObject::Detach(pmCopy);
+   BookmarkObject::Detach(pm);
+}
+
+// Counts the differences diff() reports.
+//
+class CountDifferences : public BookmarkDifferences {
+public:
+   CountDifferences() {
+      cAdded = cDeleted = 0;
+   }
+
+   void addBookmark(const Bookmark *pNew) { cAdded++; }
+   void delBookmark(const Bookmark *pOld) { cDeleted++; }
+   void add0(const BookmarkFolder *pNew)  { cAdded++; }
+   void del0(const BookmarkFolder *pOld)  { cDeleted++; }
+   void pushFolder(const BookmarkFolder *pbf) {}
+   void popFolder() {}
+
+   unsigned long cAdded, cDeleted;
+};
+
+// Throws away what is written to it, counting the bytes.
+//
+class NullOutputStream : public OutputStream {
+public:
+   NullOutputStream() {
+      cb = 0;
+   }
+
+   void write(const char *pbBuffer, size_t cbBuffer) { cb += cbBuffer; }
+   void flush() {}
+   void close() {}
+
+   size_t cb;
+};
+
+// Change the Href of every cEvery'th bookmark of pmCopy, a copy of pm.
+//
+// @return the number changed
+//
+static unsigned long ChangeBookmarks(const BookmarkModel *pm, BookmarkModel *pmCopy, unsigned long cEvery) {
+   BookmarkEditor editor(pmCopy);
+   BookmarkWalker walker(pm);
+   BookmarkWalker::Event e;
+   unsigned long ul = 0, cChanged = 0;
+   char achUrl[256];
+
+   while ((e = walker.next()) != BookmarkWalker::END) {
+      const BookmarkObject *p = walker.get();
+
+      if (e == BookmarkWalker::ENTER && walker.depth() > 0) {
+         editor.pushFolder((const BookmarkFolder *) p);
+      }
+      else if (e == BookmarkWalker::LEAVE && walker.depth() > 0) {
+         editor.popFolder();
+      }
+      else if (e == BookmarkWalker::ITEM && p->isBookmark() && ul++ % cEvery == 0) {
+         const Bookmark *pb = (const Bookmark *) p;
+         Bookmark *pbNew = NEW Bookmark(*pb);
+
+         wsprintf(achUrl, "http://www.syncit.com/changed/%lu", ul);
+         pbNew->setHref(achUrl);
+         editor.delBookmark(pb);
+         editor.addBookmark(pbNew);
+         BookmarkObject::Detach(pbNew);
+         cChanged++;
+      }
+   }
+
+   return cChanged;
+}
+
+/**
+ * The life of a big model: build it, copy it, change every cEvery'th
+ * bookmark of the copy, diff the copy against the original, walk it
+ * and write it as XBEL.  Prints the times if fPrint.
+ */
+static void Scale(const Shape &shape, unsigned long cEvery, bool fPrint) {
+   unsigned long aul[6];
+   Stopwatch sw;
+
+   BookmarkModel *pm = BuildModel(shape);
+
+   aul[0] = sw.lap();
+
+   BookmarkModel *pmCopy = NEW BookmarkModel(*pm);
+
+   aul[1] = sw.lap();
+
+   unsigned long cChanged = ChangeBookmarks(pm, pmCopy, cEvery);
+
+   aul[2] = sw.lap();
+
+   CountDifferences count;
+
+   diff(pmCopy, pm, &count);
+
+   aul[3] = sw.lap();
+
+   CHECK(count.cAdded == cChanged && count.cDeleted == cChanged);
+   CHECK(pmCopy->getBookmarkCount() == pm->getBookmarkCount());
+
+   // every folder is entered and left once, every bookmark is an item
+   //
+   BookmarkWalker walker(pmCopy);
+   BookmarkWalker::Event e;
+   unsigned long acEvents[4] = { 0, 0, 0, 0 };
+
+   while ((e = walker.next()) != BookmarkWalker::END) {
+      acEvents[e]++;
+   }
+
+   aul[4] = sw.lap();
+
+   unsigned long cFolders = shape.getNodeCount() / (shape.cBookmarks + 1);
+
+   CHECK(acEvents[BookmarkWalker::ENTER] == cFolders);
+   CHECK(acEvents[BookmarkWalker::LEAVE] == cFolders);
+   CHECK(acEvents[BookmarkWalker::ITEM] == pm->getBookmarkCount());
+
+   NullOutputStream out;
+
+   {
+      BufferedOutputStream b(&out);
+      PrintWriter w(&b);
+
+      XBELBookmarks::Write(pmCopy, w);
+      w.close();
+   }
+
+   aul[5] = sw.lap();
+
+   CHECK(out.cb > 0);
+
+   BookmarkObject::Detach(pmCopy);
+   BookmarkObject::Detach(pm);
+
+   if (fPrint) {
+      printf("%lu nodes: build %lu ms, copy %lu ms, change %lu bookmarks %lu ms\n",
+             shape.getNodeCount(), aul[0], aul[1], cChanged, aul[2]);
+      printf("%lu nodes: diff %lu ms, walk %lu ms, write %lu KB of XBEL %lu ms\n",
+             shape.getNodeCount(), aul[3], aul[4], (unsigned long) (out.cb / 1024), aul[5]);
+   }
+}
+
+static void CheckScale() {
+   Shape shape = { 3, 4, 5 };
+
+   Scale(shape, 7, false);
+}
+
+// 1.1M nodes, changing one bookmark in a thousand
+//
+static void BenchScale() {
+   Shape shape = { 5, 10, 9 };
+
+   Scale(shape, 1000, true);
+}
+
+// A model of the given shape, and a copy of it with every cEvery'th
+// bookmark changed.
+//
+static void BuildPair(const Shape &shape, unsigned long cEvery, BookmarkModel **ppmOld, BookmarkModel **ppmNew) {
+   *ppmOld = BuildModel(shape);
+   *ppmNew = NEW BookmarkModel(**ppmOld);
+   ChangeBookmarks(*ppmOld, *ppmNew, cEvery);
+}
+
+/**
+ * The sort-merge diff and the hash join find the same differences: as
+ * many of each kind, and either one's edits, applied to a copy of the
+ * old model, make it the new one.
+ */
+static void CheckHashJoin() {
+   static const Shape ashape[] = {
+      { 0, 0, 500 },    // flat
+      { 8, 2, 3 }       // deep
+   };
+
+   for (size_t i = 0; i < ELEMENTS(ashape); i++) {
+      BookmarkModel *pmOld, *pmNew;
+      CountDifferences acount[2];
+      unsigned aflags[2] = { 0, DIFF_HASH_JOIN };
+
+      BuildPair(ashape[i], 10, &pmOld, &pmNew);
+
+      for (int n = 0; n < 2; n++) {
+         BookmarkModel *pmEdit = NEW BookmarkModel(*pmOld);
+
+         diff(pmNew, pmOld, &acount[n], aflags[n]);
+
+         {
+            BookmarkEditor editor(pmEdit);
+
+            diff(pmNew, pmEdit, &editor, aflags[n]);
+         }
+
+         CHECK(pmEdit->getContentHash() == pmNew->getContentHash());
+         CHECK(pmEdit->getBookmarkCount() == pmNew->getBookmarkCount());
+
+         BookmarkObject::Detach(pmEdit);
+      }
+
+      CHECK(acount[0].cAdded > 0);
+      CHECK(acount[0].cAdded == acount[1].cAdded);
+      CHECK(acount[0].cDeleted == acount[1].cDeleted);
+
+      BookmarkObject::Detach(pmNew);
+      BookmarkObject::Detach(pmOld);
+   }
+}
+
+/**
+ * Diff with the sort-merge and with the hash join, on a flat folder of
+ * 50k bookmarks and on a tree 12 folders deep, one bookmark in ten
+ * changed.  Content hashes are computed first, so both times are of
+ * the matching alone.
+ */
+static void BenchHashJoin() {
+   static const Shape ashape[] = {
+      { 0, 0, 50000 },
+      { 12, 2, 6 }
+   };
+   static const char *const apszShape[] = { "flat", "deep" };
+   const int N = 5;
+
+   for (size_t i = 0; i < ELEMENTS(ashape); i++) {
+      BookmarkModel *pmOld, *pmNew;
+      unsigned long aul[2];
+      int n;
+
+      BuildPair(ashape[i], 10, &pmOld, &pmNew);
+      pmOld->getContentHash();
+      pmNew->getContentHash();
+
+      Stopwatch sw;
+
+      for (n = 0; n < N; n++) {
+         CountDifferences count;
+
+         diff(pmNew, pmOld, &count, 0);
+      }
+
+      aul[0] = sw.lap();
+
+      for (n = 0; n < N; n++) {
+         CountDifferences count;
+
+         diff(pmNew, pmOld, &count, DIFF_HASH_JOIN);
+      }
+
+      aul[1] = sw.lap();
+
+      printf("diff %s %lu bookmarks x%d: sort-merge %lu ms, hash join %lu ms\n",
+             apszShape[i], pmOld->getBookmarkCount(), N, aul[0], aul[1]);
+
+      BookmarkObject::Detach(pmNew);
+      BookmarkObject::Detach(pmOld);
+   }
+}
+
+// Records what diff() reports, moves included.
+//
+class RecordMoves : public CountDifferences {
+public:
+   RecordMoves() {
+      cMoves = 0;
+      pbNew = pbOld = NULL;
+      pfNew = pfOld = NULL;
+      pbfBookmarkFrom = pbfFolderFrom = NULL;
+      pRenamedNew = pRenamedOld = NULL;
+   }
+
+   bool acceptsMoves() const {
+      return true;
+   }
+
+   void moveBookmark(const Bookmark *pNew, const Bookmark *pOld, const BookmarkPath &pathOld) {
+      cMoves++;
+      pbNew = pNew;
+      pbOld = pOld;
+      pbfBookmarkFrom = pathOld.empty() ? NULL : pathOld.back();
+   }
+
+   void moveFolder(const BookmarkFolder *pNew, const BookmarkFolder *pOld, const BookmarkPath &pathOld) {
+      cMoves++;
+      pfNew = pNew;
+      pfOld = pOld;
+      pbfFolderFrom = pathOld.empty() ? NULL : pathOld.back();
+   }
+
+   void renameItem(const BookmarkItem *pNew, const BookmarkItem *pOld) {
+      cMoves++;
+      pRenamedNew = pNew;
+      pRenamedOld = pOld;
+   }
+
+   unsigned long cMoves;
+   const Bookmark *pbNew, *pbOld;
+   const BookmarkFolder *pfNew, *pfOld;
+   const BookmarkFolder *pbfBookmarkFrom, *pbfFolderFrom;
+   const BookmarkItem *pRenamedNew, *pRenamedOld;
+};
+
+// The models for CheckMoves(), before and after: bookmark x moves from
+// A to B, folder D from C to E, and bookmark r is renamed r2.
+//
+static BookmarkModel *BuildMoveModel(bool fAfter) {
+   BookmarkModel *pm = NEW BookmarkModel();
+   BookmarkContext bc(pm, NULL);
+
+   bc.pushFolder();
+
+   StartFolder(bc, "A");
+   if (!fAfter) {
+      AddBookmark(bc, "x", "http://www.syncit.com/x");
+   }
+   AddBookmark(bc, "y", "http://www.syncit.com/y");
+   EndFolder(bc);
+
+   StartFolder(bc, "B");
+   AddBookmark(bc, "z", "http://www.syncit.com/z");
+   if (fAfter) {
+      AddBookmark(bc, "x", "http://www.syncit.com/x");
+   }
+   EndFolder(bc);
+
+   StartFolder(bc, "C");
+   if (!fAfter) {
+      StartFolder(bc, "D");
+      AddBookmark(bc, "d1", "http://www.syncit.com/d1");
+      AddBookmark(bc, "d2", "http://www.syncit.com/d2");
+      EndFolder(bc);
+   }
+   EndFolder(bc);
+
+   StartFolder(bc, "E");
+   AddBookmark(bc, "e1", "http://www.syncit.com/e1");
+   if (fAfter) {
+      StartFolder(bc, "D");
+      AddBookmark(bc, "d1", "http://www.syncit.com/d1");
+      AddBookmark(bc, "d2", "http://www.syncit.com/d2");
+      EndFolder(bc);
+   }
+   EndFolder(bc);
+
+   StartFolder(bc, "F");
+   AddBookmark(bc, fAfter ? "r2" : "r", "http://www.syncit.com/r");
+   EndFolder(bc);
+
+   bc.popFolder();
+
+   return pm;
+}
+
+/**
+ * DIFF_DETECT_MOVES: a listener that accepts moves gets one call per
+ * moved or renamed item, naming the old folder it came from, and no
+ * adds or deletes; one that doesn't gets the adds and deletes, which
+ * still turn the old model into the new.
+ */
+static void CheckMoves() {
+   BookmarkModel *pmOld = BuildMoveModel(false);
+   BookmarkModel *pmNew = BuildMoveModel(true);
+   RecordMoves rec;
+
+   diff(pmNew, pmOld, &rec, DIFF_DETECT_MOVES);
+
+   CHECK(rec.cMoves == 3);
+   CHECK(rec.cAdded == 0 && rec.cDeleted == 0);
+
+   CHECK(rec.pbNew == NthFolder(pmNew, 1)->findBookmark(T("x")));
+   CHECK(rec.pbOld == NthFolder(pmOld, 0)->findBookmark(T("x")));
+   CHECK(rec.pbfBookmarkFrom == NthFolder(pmOld, 0));
+
+   CHECK(rec.pfNew == NthFolder(NthFolder(pmNew, 3), 0));
+   CHECK(rec.pfOld == NthFolder(NthFolder(pmOld, 2), 0));
+   CHECK(rec.pbfFolderFrom == NthFolder(pmOld, 2));
+
+   CHECK(rec.pRenamedNew == NthFolder(pmNew, 4)->findBookmark(T("r2")));
+   CHECK(rec.pRenamedOld == NthFolder(pmOld, 4)->findBookmark(T("r")));
+
+   CountDifferences count;
+
+   diff(pmNew, pmOld, &count, DIFF_DETECT_MOVES);
+
+   // x, r2, and D with its two bookmarks
+   //
+   CHECK(count.cAdded == 5 && count.cDeleted == 5);
+
+   BookmarkModel *pmEdit = NEW BookmarkModel(*pmOld);
+
+   {
+      BookmarkEditor editor(pmEdit);
+
+      diff(pmNew, pmEdit, &editor, DIFF_DETECT_MOVES);
+   }
+
+   CHECK(pmEdit->getContentHash() == pmNew->getContentHash());
+
+   BookmarkObject::Detach(pmEdit);
+   BookmarkObject::Detach(pmNew);
+   BookmarkObject::Detach(pmOld);
+}
+
+/**
+ * A model from a spec such as "F[a b=2] c": a folder F holding the
+ * bookmarks a and b, then a bookmark c.  Bookmark x links to
+ * http://www.syncit.com/x, or, written x=2, to http://www.syncit.com/x2.
+ */
+static BookmarkModel *BuildSpec(const char *pszSpec) {
+   BookmarkModel *pm = NEW BookmarkModel();
+   BookmarkContext bc(pm, NULL);
+   const char *p = pszSpec;
+
+   bc.pushFolder();
+
+   while (*p != '\0') {
+      char achName[64], achUrl[128];
+      size_t cch = 0;
+
+      if (*p == ' ') {
+         p++;
+         continue;
+      }
+
+      if (*p == ']') {
+         EndFolder(bc);
+         p++;
+         continue;
+      }
+
+      while (*p != '\0' && strchr(" []=", *p) == NULL && cch < sizeof(achName) - 1) {
+         achName[cch++] = *p++;
+      }
+
+      achName[cch] = '\0';
+
+      if (*p == '[') {
+         StartFolder(bc, achName);
+         p++;
+      }
+      else {
+         wsprintf(achUrl, "http://www.syncit.com/%s", achName);
+
+         if (*p == '=') {
+            size_t cchUrl = strlen(achUrl);
+
+            for (p++; *p != '\0' && strchr(" []", *p) == NULL && cchUrl < sizeof(achUrl) - 1; p++) {
+               achUrl[cchUrl++] = *p;
+            }
+
+            achUrl[cchUrl] = '\0';
+         }
+
+         AddBookmark(bc, achName, achUrl);
+      }
+   }
+
+   bc.popFolder();
+
+   return pm;
+}
+
+// Records the conflicts merge3() reports.
+//
+class RecordConflicts : public BookmarkConflicts {
+public:
+   RecordConflicts() {
+      c = 0;
+      pLastBase = pLastLocal = pLastRemote = NULL;
+   }
+
+   void conflict(const BookmarkItem *pBase, const BookmarkItem *pLocal, const BookmarkItem *pRemote) {
+      c++;
+      pLastBase = pBase;
+      pLastLocal = pLocal;
+      pLastRemote = pRemote;
+   }
+
+   unsigned long c;
+   const BookmarkItem *pLastBase, *pLastLocal, *pLastRemote;
+};
+
+// merge3() into a copy of local, as the sync does into its own copy
+//
+static BookmarkModel *Merge(const BookmarkModel *pmBase, const BookmarkModel *pmLocal, const BookmarkModel *pmRemote, RecordConflicts *pconflicts) {
+   BookmarkModel *pm = NEW BookmarkModel(*pmLocal);
+
+   {
+      BookmarkEditor editor(pm);
+
+      merge3(pmBase, pmLocal, pmRemote, &editor, pconflicts);
+   }
+
+   return pm;
+}
+
+// The bookmarks named pszName in pbf that link to pszUrl
+//
+static int CountBookmarks(const BookmarkFolder *pbf, const tchar_t *pszName, const char *pszUrl) {
+   Href href = Href::Intern(pszUrl);
+   int c = 0;
+
+   for (BookmarkVector::const_iterator i = pbf->begin(); i != pbf->end(); i++) {
+      if (*i != NULL && (*i)->isBookmark()) {
+         const Bookmark *pb = (const Bookmark *) *i;
+
+         if (tstrcmp(pb->getName(), pszName) == 0 && pb->getHref() == href) {
+            c++;
+         }
+      }
+   }
+
+   return c;
+}
+
+/**
+ * merge3(): changes on both sides go in; contents swapped between two
+ * folders of the same name on one side, while the other side edits one
+ * of them, lose nothing; and a bookmark given a different href on each
+ * side is reported and kept both ways.
+ */
+static void CheckMerge3() {
+   RecordConflicts conflicts, conflictsSwapped, conflictsHref;
+   BookmarkModel *pmBase = BuildSpec("F[a b] G[c]");
+   BookmarkModel *pmLocal = BuildSpec("F[a b l] G[c]");
+   BookmarkModel *pmRemote = BuildSpec("F[a r] G[c] H[h]");
+   BookmarkModel *pmExpected = BuildSpec("F[a l r] G[c] H[h]");
+   BookmarkModel *pm = Merge(pmBase, pmLocal, pmRemote, &conflicts);
+
+   CHECK(pm->getContentHash() == pmExpected->getContentHash());
+   CHECK(conflicts.c == 0);
+   CHECK(NthFolder(pm, 1) == NthFolder(pmLocal, 1));
+
+   BookmarkObject::Detach(pm);
+   BookmarkObject::Detach(pmExpected);
+   BookmarkObject::Detach(pmRemote);
+   BookmarkObject::Detach(pmLocal);
+   BookmarkObject::Detach(pmBase);
+
+   // remote swaps what the two S folders hold, local adds k to one
+   //
+   pmBase = BuildSpec("S[p] S[q]");
+   pmLocal = BuildSpec("S[p k] S[q]");
+   pmRemote = BuildSpec("S[q] S[p]");
+   pm = Merge(pmBase, pmLocal, pmRemote, &conflictsSwapped);
+
+   CHECK(pm->getContentHash() == pmLocal->getContentHash());
+   CHECK(pm->getBookmarkCount() == 3);
+   CHECK(conflictsSwapped.c == 0);
+
+   BookmarkObject::Detach(pm);
+   BookmarkObject::Detach(pmRemote);
+   BookmarkObject::Detach(pmLocal);
+   BookmarkObject::Detach(pmBase);
+
+   // n is given a different href on each side
+   //
+   pmBase = BuildSpec("F[n=1 o]");
+   pmLocal = BuildSpec("F[n=2 o]");
+   pmRemote = BuildSpec("F[n=3 o]");
+   pm = Merge(pmBase, pmLocal, pmRemote, &conflictsHref);
+
+   const BookmarkFolder *pbf = NthFolder(pm, 0);
+
+   CHECK(conflictsHref.c == 1);
+   CHECK(conflictsHref.pLastBase != NULL && tstrcmp(conflictsHref.pLastBase->getName(), T("n")) == 0);
+   CHECK(conflictsHref.pLastLocal != NULL && conflictsHref.pLastRemote != NULL);
+   CHECK(CountBookmarks(pbf, T("n"), "http://www.syncit.com/n1") == 0);
+   CHECK(CountBookmarks(pbf, T("n"), "http://www.syncit.com/n2") == 1);
+   CHECK(CountBookmarks(pbf, T("n"), "http://www.syncit.com/n3") == 1);
+   CHECK(CountBookmarks(pbf, T("o"), "http://www.syncit.com/o") == 1);
+
+   BookmarkObject::Detach(pm);
+   BookmarkObject::Detach(pmRemote);
+   BookmarkObject::Detach(pmLocal);
+   BookmarkObject::Detach(pmBase);
+}
+
+/**
+ * Build and tear down a 1M-node tree from the model's arena and then
+ * from the heap.  Another copy of the tree is kept meanwhile, so both
+ * find its names and Hrefs already interned and only the nodes differ.
+ */
+static void BenchArena() {
+   Shape shape = { 5, 10, 9 };
+   BookmarkModel *pmInterned = BuildModel(shape);
+   unsigned long aul[2][2];
+
+   for (int n = 0; n < 2; n++) {
+      Stopwatch sw;
+      BookmarkModel *pm = BuildModel(shape, n == 0);
+
+      aul[n][0] = sw.lap();
+      BookmarkObject::Detach(pm);
+      aul[n][1] = sw.lap();
+   }
+
+   printf("build/teardown %lu nodes: arena %lu/%lu ms, heap %lu/%lu ms\n",
+          shape.getNodeCount(), aul[0][0], aul[0][1], aul[1][0], aul[1][1]);
+
+   BookmarkObject::Detach(pmInterned);
+}
+
+int main(int argc, char *argv[]) {
+   bool fBenchmarks = !(argc > 1 && strcmp(argv[1], "-check") == 0);
+
+   CheckHrefs();
+   CheckNames();
+   CheckArena();
+   CheckCopyOnWrite();
+   CheckIndex();
+   CheckSort();
+   CheckAliases();
+   CheckScale();
+   CheckHashJoin();
+   CheckMoves();
+   CheckMerge3();
+
+   if (fBenchmarks) {
+      BenchIntern();
+      BenchArena();
+      BenchSort();
+      BenchScale();
+      BenchHashJoin();
+   }
+
+   printf("%d check(s) failed\n", gcFailed);
+
+   return gcFailed;
+}
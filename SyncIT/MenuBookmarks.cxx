@@ -137,8 +137,8 @@ void MenuBookmarks::setRoot(MenuCursor *pcursor,
       vector<const Bookmark *>::iterator bi = vb.begin(), be = vb.end();
       vector<const BookmarkFolder *>::iterator fi = vf.begin(), fe = vf.end();
 
-      sort(bi, be, BookmarkLess);
-      sort(fi, fe, BookmarkFolderLess);
+      SortBookmarks(vb);
+      SortBookmarkFolders(vf);
 
       int j = 0, k = 0;
 
@@ -203,8 +203,8 @@ void MenuBookmarks::getRoot(MenuCursor *pcursor, UINT wFolderId) {
       vector<const Bookmark *>::iterator bi = vb.begin(), be = vb.end();
       vector<const BookmarkFolder *>::iterator fi = vf.begin(), fe = vf.end();
 
-      sort(bi, be, BookmarkLess);
-      sort(fi, fe, BookmarkFolderLess);
+      SortBookmarks(vb);
+      SortBookmarkFolders(vf);
 
       int j = 0, k = 0;
 
@@ -292,8 +292,8 @@ void MenuBookmarks::populateMenu(MenuCursor &cursor, const BookmarkFolder *pbf,
    vector<const Bookmark *>::iterator bi = vb.begin(), be = vb.end();
    vector<const BookmarkFolder *>::iterator fi = vf.begin(), fe = vf.end();
 
-   sort(bi, be, BookmarkLess);
-   sort(fi, fe, BookmarkFolderLess);
+   SortBookmarks(vb);
+   SortBookmarkFolders(vf);
 
    int j = 0, k = 0;
 
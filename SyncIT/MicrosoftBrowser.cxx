@@ -159,7 +159,7 @@ void MicrosoftBrowser::writeBookmarks(const BookmarkModel *pbfNew,
                                       const char *pszBackupFilename) {
    WinFavoritesOutput writer(m_pszDirectory);
 
-   diff(pbfNew, m_bookmarks, &writer);
+   diff(pbfNew, m_bookmarks, &writer, DIFF_DETECT_MOVES);
 
    XBELBookmarks::Write(pbfNew, pszBackupFilename);
 
@@ -32,6 +32,8 @@
 #include "ProductVersion.h"
 
 #include "SyncLib/PrintWriter.h"
+#include "SyncLib/Log.h"
+#include "SyncLib/UTF8.h"
 
 #include "BookmarkLib/BookmarkEditor.h"
 #include "BookmarkLib/BrowserBookmarks.h"
@@ -43,6 +45,29 @@ static const TCHAR FILE_SUFFIX[] = TEXT(".xml");
 
 extern HINSTANCE ghResourceInstance;
 
+// merge3() keeps both changes of a conflict; they are only logged
+//
+class LogConflicts : public BookmarkConflicts {
+public:
+   virtual void conflict(const BookmarkItem *pBase,
+                         const BookmarkItem *pLocal,
+                         const BookmarkItem *pRemote) {
+#ifdef TEXT16
+      char achName[1024];    // utf-8 encodes up to max 3 bytes
+      achName[sizeof(achName) - 1] = 0;
+      utf8enc(pBase->getName(), achName, sizeof(achName) - 1);
+#else
+      const char *achName = pBase->getName();
+#endif /* TEXT16 */
+
+      Log("Merge conflict on \"%s\": %s\r\n",
+          achName,
+          pLocal == NULL ? "deleted here, changed on the server" :
+          pRemote == NULL ? "changed here, deleted on the server" :
+                            "changed on both sides");
+   }
+};
+
 /**
  * 
  * B -- the backup set
@@ -120,7 +145,7 @@ bool Synchronizer::recover(RegKey &key) {
       
                BookmarkMerger merge(m_pC);
 
-               diff(newpbm, m_pC, &merge);
+               diff(newpbm, m_pC, &merge, DIFF_EQUIVALENT_HREFS);
             }
             else {
                char achBackup[MAX_PATH];
@@ -144,8 +169,9 @@ bool Synchronizer::recover(RegKey &key) {
 
                   // edit the current set:
                   BookmarkEditor edit(m_pC);
+                  LogConflicts conflicts;
 
-                  diff(newpbm, pmbck, &edit);
+                  merge3(pmbck, m_pC, newpbm, &edit, &conflicts);
                   delete newpbm;
                }
                else {
@@ -153,7 +179,7 @@ bool Synchronizer::recover(RegKey &key) {
 
                   BookmarkMerger merge(m_pC);
 
-                  diff(newpbm, m_pC, &merge);
+                  diff(newpbm, m_pC, &merge, DIFF_EQUIVALENT_HREFS);
 
                   delete pmbck;
                }
@@ -221,7 +247,10 @@ void Synchronizer::init() {
          pb->readBookmarks(&bc, true);
          pb->setBackup(pbm);
 
-         diff(pbm, pOnDisk, &merger);
+         // the same link saved by two browsers may differ in host case,
+         // default port etc.: don't merge it twice
+         //
+         diff(pbm, pOnDisk, &merger, DIFF_EQUIVALENT_HREFS);
       }
    }
 
@@ -266,7 +295,12 @@ void Synchronizer::fileChange(Browser *pb) {
          if (pb->readBookmarks(&bc, false)) {
             BookmarkEditor editor(m_pC);
 
-            if (diff(pOnDisk, pb->getBackup(), &editor) > 0) {
+            // the editor finds each edit's folder by its path, so the
+            // order of the edits only decides where additions land in
+            // C: the menu sorts, and the server gets a sorted diff of
+            // C anyway, so the hash join's file order is as good
+            //
+            if (diff(pOnDisk, pb->getBackup(), &editor, DIFF_HASH_JOIN) > 0) {
                m_status.setPopupMenuBookmarks(m_pC);
 
                pb->setBackup(pOnDisk);
@@ -291,25 +325,6 @@ void Synchronizer::fileChange(Browser *pb) {
    m_cs.leave();
 }
 
-static unsigned long count(const BookmarkFolder *pbf) {
-   BookmarkVector::const_iterator i = pbf->begin(), end = pbf->end();
-
-   unsigned long ulResult = 0;
-
-   while (i != end) {
-      if ((*i)->isFolder()) {
-         ulResult += count((const BookmarkFolder *) (*i));
-      }
-      else if ((*i)->isBookmark()) {
-         ulResult++;
-      }
-
-      i++;
-   }
-
-   return ulResult;
-}
-
 static BOOL APIENTRY MergeDlgProc(HWND hDlg,
                                   UINT wMsg,
                                   WPARAM wParam,
@@ -368,7 +383,7 @@ static BOOL APIENTRY MergeDlgProc(HWND hDlg,
 
 void Synchronizer::response(AsyncResponse r, BookmarkModel *p) {
 
-   unsigned long ulCount = count(p);
+   unsigned long ulCount = p->getBookmarkCount();
 
    bool fMerge;
 
@@ -423,11 +438,12 @@ void Synchronizer::response(AsyncResponse r, BookmarkModel *p) {
 
             assert(m_pC != NULL);
             assert(m_bookmarks == NULL);
-            m_bookmarks = NEW BookmarkModel(*m_pC);
 
+            // from nothing, so everything of theirs that we lack
+            BookmarkModel empty;
             BookmarkMerger edit(m_pC);
 
-            diff(p, m_bookmarks, &edit);
+            merge3(&empty, m_pC, p, &edit);
 
             // any new bookmarks have now been merged
             // into m_pC
@@ -437,8 +453,9 @@ void Synchronizer::response(AsyncResponse r, BookmarkModel *p) {
             assert(m_bookmarks != NULL);
 
             BookmarkEditor edit(m_pC);
+            LogConflicts conflicts;
 
-            diff(p, m_bookmarks, &edit);
+            merge3(m_bookmarks, m_pC, p, &edit, &conflicts);
          }
 
          m_status.setPopupMenuBookmarks(m_pC);
@@ -125,16 +125,13 @@ public:
    }
 
    void appendBookmark(Command c, const Bookmark *pb) {
-      char ach[4096];
-      size_t cch = pb->getHref().format(ach, sizeof(ach));
-
       m_p->write((char) c);
       m_p->write(',');
       m_p->write('"');
       writePath(pb);
 
       m_p->print("\",\"");
-      quote(ach, cch);
+      pb->getHref().write(*m_p, '"', "\"\"");
       m_p->print("\"\r\n");
    }
 
@@ -272,10 +269,20 @@ Synchronizer::AsyncResponse Synchronizer::asyncRequest() {
 
             PostBookmarks post(&p);
 
+            // Copies of the models share all their folders, so they are
+            // cheap to take under the lock, and the diff can run without
+            // holding up the UI and the file change handler.
+            //
             m_cs.enter();
-            diff(m_pC, m_bookmarks, &post);
+            BookmarkModel *pC = NEW BookmarkModel(*m_pC);
+            BookmarkModel *pB = NEW BookmarkModel(*m_bookmarks);
             m_cs.leave();
 
+            diff(pC, pB, &post, DIFF_PARALLEL);
+
+            BookmarkObject::Detach(pC);
+            BookmarkObject::Detach(pB);
+
             result = submit(&bc, &req);
 
             if (result == OK || result == NoChange) {
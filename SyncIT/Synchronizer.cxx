@@ -1093,6 +1093,53 @@ void Synchronizer::onPermErr(AsyncResponse error) {
 //          -------- -------- -------- -------- -------- -------- -------- -------- --------
 //   syncOk    X        X     go SYNC  go SYNC     X        X        X     go IDLE  go WAIT
 //
+void Synchronizer::logMemoryStats() {
+   BookmarkMemoryStats total, stats;
+
+   m_cs.enter();
+
+   if (m_pC != NULL) {
+      m_pC->memoryStats(stats);
+   }
+   stats.log("current");
+   total.add(stats);
+
+   stats.clear();
+   if (m_bookmarks != NULL) {
+      m_bookmarks->memoryStats(stats);
+   }
+   stats.log("baseline");
+   total.add(stats);
+
+   // fileChange() replaces the backups under m_cs too
+   //
+   stats.clear();
+   for (int i = 0; i < m_nBrowsers; i++) {
+      BookmarkModel *pbm = m_apBrowsers[i]->getBackup();
+
+      if (pbm != NULL) {
+         pbm->memoryStats(stats);
+      }
+   }
+   stats.log("browser backups");
+   total.add(stats);
+
+   m_cs.leave();
+
+   stats.clear();
+   Href::MemoryStats(stats);
+   BookmarkName::MemoryStats(stats);
+   stats.log("intern tables");
+   total.add(stats);
+
+   stats.clear();
+   stats.add(BookmarkMemoryStats::IMAGES, gpLoader->getMemorySize());
+   stats.log("images");
+   total.add(stats);
+
+   total.log("total");
+}
+
 void Synchronizer::onSyncOk(AsyncResponse rcode) {
 
    assert(isValid());
@@ -1163,6 +1210,8 @@ void Synchronizer::onSyncOk(AsyncResponse rcode) {
                key.setValue(REG_SYNCED, m_dtLastSynced);
             }
 
+            logMemoryStats();
+
             if (m_state == State_SYNC) {
                // SYNC:
                //    expire == infinite
@@ -226,6 +226,11 @@ private:
 
    void save();
 
+   // write the memory used by the models and the global tables to
+   // the log
+   //
+   void logMemoryStats();
+
    ///////////////////
    // Configuration...
    //
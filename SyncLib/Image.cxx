@@ -120,3 +120,24 @@ Image *ImageLoader::load(const string &url, const URL *pbase) {
 
    return p ? p->attach() : NULL;
 }
+
+size_t ImageLoader::getMemorySize() const {
+   size_t cb = sizeof(*this);
+   Map::const_iterator i = m_map.begin(), end = m_map.end();
+
+   while (i != end) {
+      const Image *p = (*i).second;
+
+      // a map node is about a value and three pointers
+      //
+      cb += sizeof(Map::value_type) + 3 * sizeof(void *) + (*i).first.capacity();
+
+      if (p != NULL) {
+         cb += p->getWidth() * p->getHeight() * 4;
+      }
+
+      i++;
+   }
+
+   return cb;
+}
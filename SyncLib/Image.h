@@ -72,19 +72,22 @@ namespace syncit {
 
    public:
       Image() {
-         m_ulRefCount = 1;
+         m_lRefCount = 1;
       }
 
       virtual ~Image() {
       }
 
+      // Images are shared by bookmarks in models used by several
+      // threads, so the count is only changed with Interlocked calls.
+      //
       Image *attach() {
-         m_ulRefCount++;
+         InterlockedIncrement(&m_lRefCount);
          return this;
       }
 
       bool detach() {
-         return --m_ulRefCount == 0;
+         return InterlockedDecrement(&m_lRefCount) == 0;
       }
 
       static void Detach(Image *p);
@@ -103,7 +106,7 @@ namespace syncit {
       static Image Blank;
 
    private:
-      unsigned long m_ulRefCount;
+      volatile LONG m_lRefCount;
 
       // disable copy constructor and assignment operator
       //
@@ -118,6 +121,11 @@ namespace syncit {
 
       Image *load(const string &url, const URL *pbase = NULL);
 
+      // Bytes held by the cache: the map, and width * height * 4
+      // for each image as an estimate of its bitmaps.
+      //
+      size_t getMemorySize() const;
+
    private:
       HINSTANCE m_hInstance;
 